@@ -0,0 +1,482 @@
+/* arena.c - arena based memory manager for libjpeg
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <jpeglib.h>
+#include <jerror.h>
+
+#include "arena.h"
+
+
+/*
+ * Memory for the image pool (everything libjpeg allocates for decoding
+ * a single image) is taken from an arena that is only reset, not freed,
+ * between images. After a reset, blocks are coalesced into one block
+ * sized to the total used so far, so that in steady state decoding an
+ * image needs no calls to the system allocator at all. Memory used for
+ * an image larger than ARENA_RETAIN_MAX is given back after the image
+ * (arena shrinks back to a single small block), so that it is not kept
+ * outside of the --max-memory budget.
+ */
+
+#define ARENA_HEADER  ((sizeof(struct arena_block) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ROUND_UP(x, n) (((x) + (n) - 1) & ~(size_t)((n) - 1))
+
+
+void arena_init(struct arena *a, bool huge_pages)
+{
+	if (!a)
+		return;
+
+	memset(a, 0, sizeof(struct arena));
+	a->huge_pages = huge_pages;
+}
+
+
+static struct arena_block *new_block(struct arena *a, size_t size)
+{
+	struct arena_block *b = NULL;
+	size_t total = ARENA_HEADER + size;
+	bool mapped = false;
+
+	if (a->huge_pages && total >= ARENA_HUGE_MIN) {
+		/* Large blocks are mapped directly (and backed by huge pages) */
+		total = ROUND_UP(total, ARENA_HUGE_MIN);
+		void *p = mmap(NULL, total, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+			madvise(p, total, MADV_HUGEPAGE);
+#endif
+			b = p;
+			mapped = true;
+		}
+	}
+	if (!b && posix_memalign((void**)&b, ARENA_ALIGN, total) != 0)
+		return NULL;
+
+	b->next = NULL;
+	b->size = total - ARENA_HEADER;
+	b->used = 0;
+	b->mapped = mapped;
+	a->system_allocs++;
+
+	return b;
+}
+
+
+static void free_block(struct arena_block *b)
+{
+	if (b->mapped)
+		munmap(b, ARENA_HEADER + b->size);
+	else
+		free(b);
+}
+
+
+/* Allocate memory (aligned to ARENA_ALIGN) from the arena */
+void *arena_alloc(struct arena *a, size_t size)
+{
+	struct arena_block *b;
+
+	if (!a)
+		return NULL;
+	if (size > ((size_t)-1) / 2)
+		return NULL;
+	size = ROUND_UP(size, ARENA_ALIGN);
+
+	for (b = a->current; b; b = b->next) {
+		if (b->size - b->used >= size)
+			break;
+	}
+	if (!b) {
+		if (!(b = new_block(a, (size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE))))
+			return NULL;
+		if (a->current) {
+			struct arena_block *last = a->current;
+			while (last->next)
+				last = last->next;
+			last->next = b;
+		} else {
+			a->first = b;
+		}
+	}
+	a->current = b;
+
+	void *p = (char*)b + ARENA_HEADER + b->used;
+	b->used += size;
+
+	return p;
+}
+
+
+/* Release all allocations (memory is kept for reuse, up to ARENA_RETAIN_MAX) */
+void arena_reset(struct arena *a)
+{
+	size_t total = 0;
+
+	if (!a || !a->first)
+		return;
+
+	if (!a->first->next && a->first->size <= ARENA_RETAIN_MAX) {
+		a->first->used = 0;
+		a->current = a->first;
+		return;
+	}
+
+	for (struct arena_block *b = a->first; b; b = b->next)
+		total += b->size;
+	arena_free(a);
+	if ((a->first = new_block(a, (total <= ARENA_RETAIN_MAX ? total : ARENA_BLOCK_SIZE))))
+		a->current = a->first;
+}
+
+
+void arena_free(struct arena *a)
+{
+	if (!a)
+		return;
+
+	struct arena_block *b = a->first;
+	while (b) {
+		struct arena_block *next = b->next;
+		free_block(b);
+		b = next;
+	}
+	a->first = a->current = NULL;
+}
+
+
+/*****************************************************************************/
+
+/*
+ * libjpeg memory manager: image pool is allocated from the arena, and
+ * permanent pool (few small objects) using malloc(). Virtual arrays are
+ * always kept in memory (there is no backing store), if they would not fit
+ * within max_memory_to_use, JERR_NO_BACKING_STORE error is raised.
+ */
+
+struct perm_object {
+	struct perm_object *next;
+};
+
+struct jvirt_sarray_control {
+	JSAMPARRAY mem_buffer;
+	JDIMENSION rows_in_array;
+	JDIMENSION samplesperrow;
+	JDIMENSION maxaccess;
+	boolean pre_zero;
+	struct jvirt_sarray_control *next;
+};
+
+struct jvirt_barray_control {
+	JBLOCKARRAY mem_buffer;
+	JDIMENSION rows_in_array;
+	JDIMENSION blocksperrow;
+	JDIMENSION maxaccess;
+	boolean pre_zero;
+	struct jvirt_barray_control *next;
+};
+
+struct arena_mgr {
+	struct jpeg_memory_mgr pub;
+	struct jpeg_memory_mgr *orig;
+	struct arena image;
+	struct perm_object *permanent;
+	jvirt_sarray_ptr virt_sarray_list;
+	jvirt_barray_ptr virt_barray_list;
+};
+
+#define PERM_HEADER ROUND_UP(sizeof(struct perm_object), ARENA_ALIGN)
+
+
+static void *alloc_pool(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
+{
+	struct arena_mgr *m = (struct arena_mgr*)cinfo->mem;
+	void *p;
+
+	if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
+		ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+	if (sizeofobject > (size_t)m->pub.max_alloc_chunk)
+		ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 1);
+
+	if (pool_id == JPOOL_IMAGE) {
+		if (!(p = arena_alloc(&m->image, sizeofobject)))
+			ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 2);
+		return p;
+	}
+
+	struct perm_object *o = NULL;
+	if (posix_memalign((void**)&o, ARENA_ALIGN, PERM_HEADER + sizeofobject) != 0)
+		ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 3);
+	o->next = m->permanent;
+	m->permanent = o;
+
+	return (char*)o + PERM_HEADER;
+}
+
+
+static void *alloc_small(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
+{
+	return alloc_pool(cinfo, pool_id, sizeofobject);
+}
+
+
+static void *alloc_large(j_common_ptr cinfo, int pool_id, size_t sizeofobject)
+{
+	return alloc_pool(cinfo, pool_id, sizeofobject);
+}
+
+
+static JSAMPARRAY alloc_sarray(j_common_ptr cinfo, int pool_id,
+			JDIMENSION samplesperrow, JDIMENSION numrows)
+{
+	/* Rows are padded (like libjpeg-turbo does), SIMD code may overrun them */
+	size_t rowsize = ROUND_UP((size_t)samplesperrow * sizeof(JSAMPLE), ARENA_ALIGN);
+
+	if (numrows > 0 && rowsize > ((size_t)-1) / 2 / numrows)
+		ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
+
+	JSAMPARRAY result = alloc_pool(cinfo, pool_id, sizeof(JSAMPROW) * numrows);
+	JSAMPROW rows = alloc_pool(cinfo, pool_id, rowsize * numrows);
+	for (JDIMENSION i = 0; i < numrows; i++)
+		result[i] = rows + i * rowsize / sizeof(JSAMPLE);
+
+	return result;
+}
+
+
+static JBLOCKARRAY alloc_barray(j_common_ptr cinfo, int pool_id,
+				JDIMENSION blocksperrow, JDIMENSION numrows)
+{
+	size_t rowsize = (size_t)blocksperrow * sizeof(JBLOCK);
+
+	if (numrows > 0 && rowsize > ((size_t)-1) / 2 / numrows)
+		ERREXIT(cinfo, JERR_WIDTH_OVERFLOW);
+
+	JBLOCKARRAY result = alloc_pool(cinfo, pool_id, sizeof(JBLOCKROW) * numrows);
+	JBLOCKROW rows = alloc_pool(cinfo, pool_id, rowsize * numrows);
+	for (JDIMENSION i = 0; i < numrows; i++)
+		result[i] = rows + (size_t)i * blocksperrow;
+
+	return result;
+}
+
+
+static jvirt_sarray_ptr request_virt_sarray(j_common_ptr cinfo, int pool_id,
+					boolean pre_zero, JDIMENSION samplesperrow,
+					JDIMENSION numrows, JDIMENSION maxaccess)
+{
+	struct arena_mgr *m = (struct arena_mgr*)cinfo->mem;
+
+	if (pool_id != JPOOL_IMAGE)
+		ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+
+	jvirt_sarray_ptr result = alloc_pool(cinfo, pool_id,
+					sizeof(struct jvirt_sarray_control));
+	result->mem_buffer = NULL;
+	result->rows_in_array = numrows;
+	result->samplesperrow = samplesperrow;
+	result->maxaccess = maxaccess;
+	result->pre_zero = pre_zero;
+	result->next = m->virt_sarray_list;
+	m->virt_sarray_list = result;
+
+	return result;
+}
+
+
+static jvirt_barray_ptr request_virt_barray(j_common_ptr cinfo, int pool_id,
+					boolean pre_zero, JDIMENSION blocksperrow,
+					JDIMENSION numrows, JDIMENSION maxaccess)
+{
+	struct arena_mgr *m = (struct arena_mgr*)cinfo->mem;
+
+	if (pool_id != JPOOL_IMAGE)
+		ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+
+	jvirt_barray_ptr result = alloc_pool(cinfo, pool_id,
+					sizeof(struct jvirt_barray_control));
+	result->mem_buffer = NULL;
+	result->rows_in_array = numrows;
+	result->blocksperrow = blocksperrow;
+	result->maxaccess = maxaccess;
+	result->pre_zero = pre_zero;
+	result->next = m->virt_barray_list;
+	m->virt_barray_list = result;
+
+	return result;
+}
+
+
+static void realize_virt_arrays(j_common_ptr cinfo)
+{
+	struct arena_mgr *m = (struct arena_mgr*)cinfo->mem;
+	long long space = 0;
+
+	for (jvirt_sarray_ptr s = m->virt_sarray_list; s; s = s->next) {
+		if (!s->mem_buffer)
+			space += (long long)s->rows_in_array * s->samplesperrow * sizeof(JSAMPLE);
+	}
+	for (jvirt_barray_ptr b = m->virt_barray_list; b; b = b->next) {
+		if (!b->mem_buffer)
+			space += (long long)b->rows_in_array * b->blocksperrow * sizeof(JBLOCK);
+	}
+	if (m->pub.max_memory_to_use > 0 && space > m->pub.max_memory_to_use)
+		ERREXIT(cinfo, JERR_NO_BACKING_STORE);
+
+	for (jvirt_sarray_ptr s = m->virt_sarray_list; s; s = s->next) {
+		if (s->mem_buffer)
+			continue;
+		s->mem_buffer = alloc_sarray(cinfo, JPOOL_IMAGE, s->samplesperrow,
+					s->rows_in_array);
+		if (s->pre_zero) {
+			for (JDIMENSION i = 0; i < s->rows_in_array; i++)
+				memset(s->mem_buffer[i], 0, s->samplesperrow * sizeof(JSAMPLE));
+		}
+	}
+	for (jvirt_barray_ptr b = m->virt_barray_list; b; b = b->next) {
+		if (b->mem_buffer)
+			continue;
+		b->mem_buffer = alloc_barray(cinfo, JPOOL_IMAGE, b->blocksperrow,
+					b->rows_in_array);
+		if (b->pre_zero && b->rows_in_array > 0)
+			memset(b->mem_buffer[0], 0, (size_t)b->rows_in_array *
+				b->blocksperrow * sizeof(JBLOCK));
+	}
+}
+
+
+static JSAMPARRAY access_virt_sarray(j_common_ptr cinfo, jvirt_sarray_ptr ptr,
+				JDIMENSION start_row, JDIMENSION num_rows,
+				boolean writable)
+{
+	if ((long long)start_row + num_rows > ptr->rows_in_array ||
+		num_rows > ptr->maxaccess || !ptr->mem_buffer)
+		ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+
+	return ptr->mem_buffer + start_row;
+}
+
+
+static JBLOCKARRAY access_virt_barray(j_common_ptr cinfo, jvirt_barray_ptr ptr,
+				JDIMENSION start_row, JDIMENSION num_rows,
+				boolean writable)
+{
+	if ((long long)start_row + num_rows > ptr->rows_in_array ||
+		num_rows > ptr->maxaccess || !ptr->mem_buffer)
+		ERREXIT(cinfo, JERR_BAD_VIRTUAL_ACCESS);
+
+	return ptr->mem_buffer + start_row;
+}
+
+
+static void free_pool(j_common_ptr cinfo, int pool_id)
+{
+	struct arena_mgr *m = (struct arena_mgr*)cinfo->mem;
+
+	if (pool_id < 0 || pool_id >= JPOOL_NUMPOOLS)
+		ERREXIT1(cinfo, JERR_BAD_POOL_ID, pool_id);
+
+	if (pool_id == JPOOL_IMAGE) {
+		m->virt_sarray_list = NULL;
+		m->virt_barray_list = NULL;
+		arena_reset(&m->image);
+		return;
+	}
+
+	while (m->permanent) {
+		struct perm_object *next = m->permanent->next;
+		free(m->permanent);
+		m->permanent = next;
+	}
+}
+
+
+static void self_destruct(j_common_ptr cinfo)
+{
+	struct arena_mgr *m = (struct arena_mgr*)cinfo->mem;
+
+	free_pool(cinfo, JPOOL_IMAGE);
+	free_pool(cinfo, JPOOL_PERMANENT);
+	arena_free(&m->image);
+
+	/* Let original memory manager free the objects allocated by it */
+	cinfo->mem = m->orig;
+	free(m);
+	(*cinfo->mem->self_destruct)(cinfo);
+}
+
+
+/* Return number of blocks allocated (from system) for the image pool */
+long jpeg_arena_allocs(j_common_ptr cinfo)
+{
+	if (!cinfo || !cinfo->mem || cinfo->mem->self_destruct != self_destruct)
+		return -1;
+
+	return ((struct arena_mgr*)cinfo->mem)->image.system_allocs;
+}
+
+
+/*
+ * Replace memory manager of (newly created) libjpeg object with an arena
+ * based one. Objects allocated before this are left to the original manager.
+ */
+void jpeg_arena_mgr(j_common_ptr cinfo, bool huge_pages)
+{
+	struct arena_mgr *m;
+
+	if (!cinfo || !cinfo->mem)
+		return;
+	if (!(m = calloc(1, sizeof(struct arena_mgr))))
+		ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 0);
+
+	m->orig = cinfo->mem;
+	m->pub.alloc_small = alloc_small;
+	m->pub.alloc_large = alloc_large;
+	m->pub.alloc_sarray = alloc_sarray;
+	m->pub.alloc_barray = alloc_barray;
+	m->pub.request_virt_sarray = request_virt_sarray;
+	m->pub.request_virt_barray = request_virt_barray;
+	m->pub.realize_virt_arrays = realize_virt_arrays;
+	m->pub.access_virt_sarray = access_virt_sarray;
+	m->pub.access_virt_barray = access_virt_barray;
+	m->pub.free_pool = free_pool;
+	m->pub.self_destruct = self_destruct;
+	m->pub.max_memory_to_use = m->orig->max_memory_to_use;
+	m->pub.max_alloc_chunk = m->orig->max_alloc_chunk;
+	arena_init(&m->image, huge_pages);
+
+	cinfo->mem = &m->pub;
+}
+
+/* eof :-) */
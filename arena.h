@@ -0,0 +1,40 @@
+/* arena.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <stdbool.h>
+
+#define ARENA_ALIGN       64
+#define ARENA_BLOCK_SIZE  (1024 * 1024)
+#define ARENA_RETAIN_MAX  (16 * 1024 * 1024)
+#define ARENA_HUGE_MIN    (2 * 1024 * 1024)
+
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	bool mapped;
+};
+
+struct arena {
+	struct arena_block *first;
+	struct arena_block *current;
+	bool huge_pages;
+	long system_allocs;
+};
+
+void arena_init(struct arena *a, bool huge_pages);
+void *arena_alloc(struct arena *a, size_t size);
+void arena_reset(struct arena *a);
+void arena_free(struct arena *a);
+
+void jpeg_arena_mgr(j_common_ptr cinfo, bool huge_pages);
+long jpeg_arena_allocs(j_common_ptr cinfo);
+
+
+#endif /* ARENA_H */
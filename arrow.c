@@ -0,0 +1,510 @@
+/* arrow.c - Apache Arrow IPC (stream and file) output
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "jpeginfo.h"
+#include "arrow.h"
+
+
+/*
+ * Records are collected into columns and written out as Arrow record
+ * batches of (up to) ARROW_BATCH_ROWS rows, so that the output can be
+ * loaded (or memory-mapped) by analytics tools without any parsing.
+ * The (flatbuffer) metadata is simple enough to be built here directly:
+ * tables are laid out before their children, and references to children
+ * are patched in once the children have been written.
+ */
+
+enum arrow_type {
+	ARROW_INT32 = 0,
+	ARROW_INT64,
+	ARROW_BOOL,
+	ARROW_UTF8
+};
+
+/* Arrow (Schema.fbs / Message.fbs) constants */
+#define METADATA_V5      4
+#define HEADER_SCHEMA    1
+#define HEADER_BATCH     3
+#define TYPE_INT         2
+#define TYPE_UTF8        5
+#define TYPE_BOOL        6
+
+static const unsigned char arrow_magic[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+
+static const struct {
+	int field;
+	enum arrow_type type;
+} arrow_columns[ARROW_COLUMNS] = {
+	{ FIELD_FILENAME,      ARROW_UTF8 },
+	{ FIELD_SIZE,          ARROW_INT64 },
+	{ FIELD_HASH,          ARROW_UTF8 },
+	{ FIELD_WIDTH,         ARROW_INT32 },
+	{ FIELD_HEIGHT,        ARROW_INT32 },
+	{ FIELD_COLOR_DEPTH,   ARROW_INT32 },
+	{ FIELD_TYPE,          ARROW_UTF8 },
+	{ FIELD_PROGRESSIVE,   ARROW_BOOL },
+	{ FIELD_INFO,          ARROW_UTF8 },
+	{ FIELD_COMMENTS,      ARROW_UTF8 },
+	{ FIELD_STATUS,        ARROW_UTF8 },
+	{ FIELD_STATUS_DETAIL, ARROW_UTF8 },
+	{ FIELD_OFFSET,        ARROW_INT64 },
+};
+
+
+static void put_le(struct outbuf *ob, unsigned long long val, int bytes)
+{
+	char *p = outbuf_reserve(ob, bytes);
+
+	for (int i = 0; i < bytes; i++)
+		p[i] = (char)(val >> (8 * i));
+	ob->len += bytes;
+}
+
+
+static void set_le(struct outbuf *ob, size_t pos, unsigned long long val, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		ob->buf[pos + i] = (char)(val >> (8 * i));
+}
+
+
+static void pad_to(struct outbuf *ob, size_t align, size_t extra)
+{
+	while ((ob->len + extra) % align)
+		outbuf_putc(ob, 0);
+}
+
+
+/* Flatbuffer builder ******************************************************/
+
+enum fb_type {
+	FB_ABSENT = 0,
+	FB_U8,
+	FB_I16,
+	FB_I32,
+	FB_I64,
+	FB_REF
+};
+
+struct fb_field {
+	enum fb_type type;
+	long long value;
+};
+
+static const int fb_sizes[] = { 0, 1, 2, 4, 8, 4 };
+
+
+/*
+ * Write table (preceded by its vtable). Positions of references (FB_REF)
+ * are returned in refs, to be patched using fb_patch().
+ */
+static size_t fb_table(struct outbuf *ob, const struct fb_field *f, int n, size_t *refs)
+{
+	unsigned short offsets[16];
+	size_t pos = 4;
+
+	/* Fields are laid out largest first, so each is naturally aligned */
+	for (int size = 8; size >= 1; size /= 2) {
+		for (int i = 0; i < n; i++) {
+			if (fb_sizes[f[i].type] != size)
+				continue;
+			if (size == 8 && pos == 4)
+				pos = 8;
+			offsets[i] = pos;
+			pos += size;
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		if (f[i].type == FB_ABSENT)
+			offsets[i] = 0;
+	}
+
+	size_t vt_size = 4 + 2 * n;
+	pad_to(ob, 8, vt_size);
+	size_t vtable = ob->len;
+	put_le(ob, vt_size, 2);
+	put_le(ob, pos, 2);
+	for (int i = 0; i < n; i++)
+		put_le(ob, offsets[i], 2);
+
+	size_t table = ob->len;
+	memset(outbuf_reserve(ob, pos), 0, pos);
+	ob->len += pos;
+	set_le(ob, table, table - vtable, 4);
+	for (int i = 0; i < n; i++) {
+		if (f[i].type == FB_ABSENT)
+			continue;
+		set_le(ob, table + offsets[i], f[i].value, fb_sizes[f[i].type]);
+		if (f[i].type == FB_REF && refs)
+			refs[i] = table + offsets[i];
+	}
+
+	return table;
+}
+
+
+/* Begin vector, elements are written by the caller */
+static size_t fb_vector(struct outbuf *ob, size_t count, size_t align)
+{
+	pad_to(ob, (align > 4 ? align : 4), 4);
+	size_t pos = ob->len;
+	put_le(ob, count, 4);
+
+	return pos;
+}
+
+
+static size_t fb_string(struct outbuf *ob, const char *s)
+{
+	size_t len = strlen(s);
+
+	pad_to(ob, 4, 0);
+	size_t pos = ob->len;
+	put_le(ob, len, 4);
+	outbuf_write(ob, s, len);
+	outbuf_putc(ob, 0);
+
+	return pos;
+}
+
+
+static void fb_patch(struct outbuf *ob, size_t ref, size_t target)
+{
+	set_le(ob, ref, target - ref, 4);
+}
+
+
+/* Arrow metadata *************************************************************/
+
+static size_t write_field(struct outbuf *ob, int col)
+{
+	enum arrow_type type = arrow_columns[col].type;
+	struct fb_field f[6] = {
+		{ FB_REF, 0 },		/* name */
+		{ FB_ABSENT, 0 },	/* nullable */
+		{ FB_U8, (type == ARROW_UTF8 ? TYPE_UTF8 :
+				(type == ARROW_BOOL ? TYPE_BOOL : TYPE_INT)) },
+		{ FB_REF, 0 },		/* type */
+		{ FB_ABSENT, 0 },	/* dictionary */
+		{ FB_REF, 0 },		/* children */
+	};
+	size_t refs[6];
+	size_t table = fb_table(ob, f, 6, refs);
+
+	fb_patch(ob, refs[0], fb_string(ob, record_fields[arrow_columns[col].field].name));
+	if (type == ARROW_INT32 || type == ARROW_INT64) {
+		struct fb_field t[2] = {
+			{ FB_I32, (type == ARROW_INT32 ? 32 : 64) },	/* bitWidth */
+			{ FB_U8, 1 },					/* is_signed */
+		};
+		fb_patch(ob, refs[3], fb_table(ob, t, 2, NULL));
+	} else {
+		fb_patch(ob, refs[3], fb_table(ob, NULL, 0, NULL));
+	}
+	fb_patch(ob, refs[5], fb_vector(ob, 0, 4));
+
+	return table;
+}
+
+
+static size_t write_schema(struct outbuf *ob)
+{
+	struct fb_field f[2] = {
+		{ FB_ABSENT, 0 },	/* endianness (little) */
+		{ FB_REF, 0 },		/* fields */
+	};
+	size_t refs[2];
+	size_t table = fb_table(ob, f, 2, refs);
+
+	size_t vec = fb_vector(ob, ARROW_COLUMNS, 4);
+	fb_patch(ob, refs[1], vec);
+	memset(outbuf_reserve(ob, 4 * ARROW_COLUMNS), 0, 4 * ARROW_COLUMNS);
+	ob->len += 4 * ARROW_COLUMNS;
+	for (int i = 0; i < ARROW_COLUMNS; i++)
+		fb_patch(ob, vec + 4 + 4 * i, write_field(ob, i));
+
+	return table;
+}
+
+
+/* Start message (flatbuffer), returns position of the header reference */
+static size_t begin_message(struct outbuf *ob, int header_type, long long body_len)
+{
+	struct fb_field f[4] = {
+		{ FB_I16, METADATA_V5 },
+		{ FB_U8, header_type },
+		{ FB_REF, 0 },
+		{ FB_I64, body_len },
+	};
+	size_t refs[4];
+
+	ob->len = 0;
+	put_le(ob, 0, 4);
+	fb_patch(ob, 0, fb_table(ob, f, 4, refs));
+
+	return refs[2];
+}
+
+
+static int write_bytes(struct arrow_writer *w, FILE *out, const void *buf, size_t len)
+{
+	static const char zeros[8] = { 0 };
+
+	if (len > 0 && fwrite(buf, 1, len, out) != len)
+		return -1;
+	w->written += len;
+
+	/* Everything is padded to 8 byte boundary */
+	if (w->written % 8) {
+		size_t pad = 8 - w->written % 8;
+		if (fwrite(zeros, 1, pad, out) != pad)
+			return -1;
+		w->written += pad;
+	}
+
+	return 0;
+}
+
+
+/* Write encapsulated message (metadata is in w->meta), body is written by caller */
+static int write_message(struct arrow_writer *w, FILE *out, long long body_len)
+{
+	unsigned char prefix[8] = { 0xff, 0xff, 0xff, 0xff };
+	size_t meta_len = (w->meta.len + 7) & ~(size_t)7;
+	long long offset = w->written;
+
+	for (int i = 0; i < 4; i++)
+		prefix[4 + i] = (unsigned char)(meta_len >> (8 * i));
+	if (write_bytes(w, out, prefix, 8) < 0 || write_bytes(w, out, w->meta.buf, w->meta.len) < 0)
+		return -1;
+
+	/* Record location of the record batches (for the file footer) */
+	if (w->file_format && body_len >= 0) {
+		put_le(&w->blocks, offset, 8);
+		put_le(&w->blocks, meta_len + 8, 4);
+		put_le(&w->blocks, 0, 4);
+		put_le(&w->blocks, body_len, 8);
+	}
+
+	return 0;
+}
+
+
+/* Record batches *************************************************************/
+
+static size_t padded(size_t len)
+{
+	return (len + 7) & ~(size_t)7;
+}
+
+
+static int write_batch(struct arrow_writer *w, FILE *out)
+{
+	struct fb_field f[3] = {
+		{ FB_I64, w->rows },	/* length */
+		{ FB_REF, 0 },		/* nodes */
+		{ FB_REF, 0 },		/* buffers */
+	};
+	struct outbuf *ob = &w->meta;
+	size_t refs[3];
+	long long body_len = 0, offset = 0;
+	int buffers = 0;
+
+	if (w->rows < 1)
+		return 0;
+
+	for (int i = 0; i < ARROW_COLUMNS; i++) {
+		struct arrow_column *c = &w->columns[i];
+		body_len += padded(c->offsets.len) + padded(c->data.len);
+		buffers += (arrow_columns[i].type == ARROW_UTF8 ? 3 : 2);
+	}
+
+	size_t header = begin_message(ob, HEADER_BATCH, body_len);
+	fb_patch(ob, header, fb_table(ob, f, 3, refs));
+
+	fb_patch(ob, refs[1], fb_vector(ob, ARROW_COLUMNS, 8));
+	for (int i = 0; i < ARROW_COLUMNS; i++) {
+		put_le(ob, w->rows, 8);		/* length */
+		put_le(ob, 0, 8);		/* null_count */
+	}
+
+	/* Validity bitmaps are left out (there are no nulls) */
+	fb_patch(ob, refs[2], fb_vector(ob, buffers, 8));
+	for (int i = 0; i < ARROW_COLUMNS; i++) {
+		struct arrow_column *c = &w->columns[i];
+
+		put_le(ob, offset, 8);
+		put_le(ob, 0, 8);
+		if (arrow_columns[i].type == ARROW_UTF8) {
+			put_le(ob, offset, 8);
+			put_le(ob, c->offsets.len, 8);
+			offset += padded(c->offsets.len);
+		}
+		put_le(ob, offset, 8);
+		put_le(ob, c->data.len, 8);
+		offset += padded(c->data.len);
+	}
+
+	if (write_message(w, out, body_len) < 0)
+		return -1;
+	for (int i = 0; i < ARROW_COLUMNS; i++) {
+		struct arrow_column *c = &w->columns[i];
+
+		if (arrow_columns[i].type == ARROW_UTF8
+			&& write_bytes(w, out, c->offsets.buf, c->offsets.len) < 0)
+			return -1;
+		if (write_bytes(w, out, c->data.buf, c->data.len) < 0)
+			return -1;
+		c->offsets.len = 0;
+		c->data.len = 0;
+	}
+	w->rows = 0;
+
+	return 0;
+}
+
+
+/* Start output: file magic (in file format) and the schema */
+int arrow_begin(struct arrow_writer *w, FILE *out, bool file_format)
+{
+	if (!w || !out)
+		return -1;
+
+	w->file_format = file_format;
+	w->rows = 0;
+	w->written = 0;
+	w->blocks.len = 0;
+	if (file_format && write_bytes(w, out, arrow_magic, sizeof(arrow_magic)) < 0)
+		return -1;
+
+	size_t header = begin_message(&w->meta, HEADER_SCHEMA, 0);
+	fb_patch(&w->meta, header, write_schema(&w->meta));
+
+	return write_message(w, out, -1);
+}
+
+
+/* Add record into current batch, batch is written out when it is full */
+int arrow_append(struct arrow_writer *w, const struct jpeg_info *info, FILE *out)
+{
+	if (!w || !info)
+		return -1;
+
+	for (int i = 0; i < ARROW_COLUMNS; i++) {
+		struct arrow_column *c = &w->columns[i];
+		const int field = arrow_columns[i].field;
+
+		switch (arrow_columns[i].type) {
+		case ARROW_INT32:
+			put_le(&c->data, record_number(info, field), 4);
+			break;
+		case ARROW_INT64:
+			put_le(&c->data, record_number(info, field), 8);
+			break;
+		case ARROW_BOOL:
+			if (w->rows % 8 == 0)
+				outbuf_putc(&c->data, 0);
+			if (record_number(info, field))
+				c->data.buf[c->data.len - 1] |= (1 << (w->rows % 8));
+			break;
+		case ARROW_UTF8:
+			if (c->offsets.len == 0)
+				put_le(&c->offsets, 0, 4);
+			outbuf_puts(&c->data, record_string(info, field));
+			put_le(&c->offsets, c->data.len, 4);
+			break;
+		}
+	}
+
+	if (++w->rows >= ARROW_BATCH_ROWS)
+		return write_batch(w, out);
+
+	return 0;
+}
+
+
+/* Write out last batch and end of stream marker (and footer in file format) */
+int arrow_finish(struct arrow_writer *w, FILE *out)
+{
+	static const unsigned char eos[8] = { 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0 };
+
+	if (!w || !out)
+		return -1;
+
+	if (write_batch(w, out) < 0 || write_bytes(w, out, eos, sizeof(eos)) < 0)
+		return -1;
+	if (!w->file_format)
+		return 0;
+
+	struct fb_field f[4] = {
+		{ FB_I16, METADATA_V5 },	/* version */
+		{ FB_REF, 0 },			/* schema */
+		{ FB_ABSENT, 0 },		/* dictionaries */
+		{ FB_REF, 0 },			/* recordBatches */
+	};
+	struct outbuf *ob = &w->meta;
+	size_t refs[4];
+
+	ob->len = 0;
+	put_le(ob, 0, 4);
+	fb_patch(ob, 0, fb_table(ob, f, 4, refs));
+	fb_patch(ob, refs[1], write_schema(ob));
+	fb_patch(ob, refs[3], fb_vector(ob, w->blocks.len / 24, 8));
+	outbuf_write(ob, w->blocks.buf, w->blocks.len);
+	put_le(ob, ob->len, 4);
+	outbuf_write(ob, (const char*)arrow_magic, 6);
+
+	if (fwrite(ob->buf, 1, ob->len, out) != ob->len)
+		return -1;
+	w->written += ob->len;
+
+	return 0;
+}
+
+
+void arrow_free(struct arrow_writer *w)
+{
+	if (!w)
+		return;
+
+	for (int i = 0; i < ARROW_COLUMNS; i++) {
+		outbuf_free(&w->columns[i].data);
+		outbuf_free(&w->columns[i].offsets);
+	}
+	outbuf_free(&w->blocks);
+	outbuf_free(&w->meta);
+	memset(w, 0, sizeof(struct arrow_writer));
+}
+
+/* eof :-) */
@@ -0,0 +1,38 @@
+/* arrow.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef ARROW_H
+#define ARROW_H 1
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "outbuf.h"
+#include "format.h"
+
+#define ARROW_BATCH_ROWS 65536
+#define ARROW_COLUMNS    13
+
+struct arrow_column {
+	struct outbuf data;
+	struct outbuf offsets;
+};
+
+struct arrow_writer {
+	bool file_format;
+	long rows;
+	long long written;
+	struct arrow_column columns[ARROW_COLUMNS];
+	struct outbuf blocks;
+	struct outbuf meta;
+};
+
+int arrow_begin(struct arrow_writer *w, FILE *out, bool file_format);
+int arrow_append(struct arrow_writer *w, const struct jpeg_info *info, FILE *out);
+int arrow_finish(struct arrow_writer *w, FILE *out);
+void arrow_free(struct arrow_writer *w);
+
+
+#endif /* ARROW_H */
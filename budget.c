@@ -0,0 +1,174 @@
+/* budget.c - memory budget shared between (worker) processes
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include "jpeginfo.h"
+#include "budget.h"
+
+
+/*
+ * Budget lives in shared memory created before worker processes are
+ * forked. Each process holds at most one reservation (slot) at a time.
+ * Reservations (and the lock) of processes that have died are reclaimed,
+ * so a crashing worker cannot leak its share of the budget.
+ */
+
+static int my_slot = -1;
+
+
+static bool process_alive(pid_t pid)
+{
+	return (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+
+static void budget_lock(struct mem_budget *b)
+{
+	pid_t self = getpid();
+
+	while (1) {
+		pid_t owner = 0;
+		if (__atomic_compare_exchange_n(&b->lock, &owner, self, false,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return;
+		if (!process_alive(owner))
+			__atomic_compare_exchange_n(&b->lock, &owner, 0, false,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		sched_yield();
+	}
+}
+
+
+static void budget_unlock(struct mem_budget *b)
+{
+	__atomic_store_n(&b->lock, 0, __ATOMIC_RELEASE);
+}
+
+
+struct mem_budget *budget_create(long long limit)
+{
+	struct mem_budget *b = mmap(NULL, sizeof(struct mem_budget),
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (b == MAP_FAILED) {
+		fprintf(stderr, "jpeginfo: cannot allocate shared memory: %s\n",
+			strerror(errno));
+		return NULL;
+	}
+
+	memset(b, 0, sizeof(struct mem_budget));
+	b->limit = limit;
+
+	return b;
+}
+
+
+/*
+ * Reserve given amount of memory from the budget, waiting (until deadline,
+ * in CLOCK_MONOTONIC nanoseconds, if non-zero) for others to release their
+ * reservations if needed. Returns 0 on success, -1 if amount exceeds the
+ * whole budget, and -2 if deadline was reached.
+ */
+int budget_acquire(struct mem_budget *b, long long amount, long long deadline)
+{
+	struct timespec ts, delay = { 0, BUDGET_POLL_INTERVAL * 1000000L };
+
+	if (!b)
+		return 0;
+	if (amount > b->limit)
+		return -1;
+	budget_release(b);
+
+	while (1) {
+		int slot = -1;
+
+		budget_lock(b);
+		for (int i = 0; i < BUDGET_SLOTS; i++) {
+			struct budget_slot *s = &b->slots[i];
+			if (s->pid > 0 && !process_alive(s->pid)) {
+				b->used -= s->amount;
+				s->pid = 0;
+				s->amount = 0;
+			}
+			if (s->pid == 0 && slot < 0)
+				slot = i;
+		}
+		if (slot >= 0 && b->used + amount <= b->limit) {
+			b->slots[slot].pid = getpid();
+			b->slots[slot].amount = amount;
+			b->used += amount;
+			my_slot = slot;
+			budget_unlock(b);
+			return 0;
+		}
+		budget_unlock(b);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		if (deadline > 0 && ts.tv_sec * 1000000000LL + ts.tv_nsec >= deadline)
+			return -2;
+		nanosleep(&delay, NULL);
+	}
+}
+
+
+/* Release reservation held by this process (if any) */
+void budget_release(struct mem_budget *b)
+{
+	if (!b || my_slot < 0)
+		return;
+
+	budget_lock(b);
+	struct budget_slot *s = &b->slots[my_slot];
+	if (s->pid == getpid()) {
+		b->used -= s->amount;
+		s->pid = 0;
+		s->amount = 0;
+	}
+	budget_unlock(b);
+	my_slot = -1;
+}
+
+
+void budget_destroy(struct mem_budget *b)
+{
+	if (b)
+		munmap(b, sizeof(struct mem_budget));
+}
+
+/* eof :-) */
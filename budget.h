@@ -0,0 +1,33 @@
+/* budget.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef BUDGET_H
+#define BUDGET_H 1
+
+#include <sys/types.h>
+
+#define BUDGET_SLOTS         1024
+#define BUDGET_POLL_INTERVAL 10 /* ms */
+
+struct budget_slot {
+	pid_t pid;
+	long long amount;
+};
+
+struct mem_budget {
+	pid_t lock;
+	long long limit;
+	long long used;
+	struct budget_slot slots[BUDGET_SLOTS];
+};
+
+struct mem_budget *budget_create(long long limit);
+int budget_acquire(struct mem_budget *b, long long amount, long long deadline);
+void budget_release(struct mem_budget *b);
+void budget_destroy(struct mem_budget *b);
+
+
+#endif /* BUDGET_H */
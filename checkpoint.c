@@ -0,0 +1,131 @@
+/* checkpoint.c - saving and restoring progress of long runs
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "jpeginfo.h"
+#include "checkpoint.h"
+
+
+#define CHECKPOINT_MAGIC "jpeginfo-checkpoint 1"
+
+
+/*
+ * Load checkpoint from a file. Returns 1 if checkpoint was loaded, 0 if
+ * there is no checkpoint file (yet), and -1 on errors.
+ */
+int checkpoint_load(const char *path, struct checkpoint *ck)
+{
+	char line[256], key[64];
+	long long val;
+
+	if (!path || !ck)
+		return -1;
+
+	memset(ck, 0, sizeof(struct checkpoint));
+	ck->output_offset = -1;
+
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return (errno == ENOENT ? 0 : -1);
+
+	if (!fgetstr(line, sizeof(line), fp) || strcmp(line, CHECKPOINT_MAGIC)) {
+		fprintf(stderr, "jpeginfo: invalid checkpoint file: %s\n", path);
+		fclose(fp);
+		return -1;
+	}
+	while (fgetstr(line, sizeof(line), fp)) {
+		if (sscanf(line, "%63s %lld", key, &val) != 2)
+			continue;
+		if (!strcmp(key, "position"))
+			ck->position = val;
+		else if (!strcmp(key, "errors"))
+			ck->errors = val;
+		else if (!strcmp(key, "records"))
+			ck->records = val;
+		else if (!strcmp(key, "header"))
+			ck->header = val;
+		else if (!strcmp(key, "output_offset"))
+			ck->output_offset = val;
+		else if (!strcmp(key, "complete"))
+			ck->complete = val;
+	}
+	fclose(fp);
+
+	return 1;
+}
+
+
+/* Save checkpoint atomically (write into temporary file and rename it) */
+int checkpoint_save(const char *path, const struct checkpoint *ck)
+{
+	char tmp[MAXPATHLEN + 16];
+
+	if (!path || !ck)
+		return -1;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	FILE *fp = fopen(tmp, "w");
+	if (!fp) {
+		fprintf(stderr, "jpeginfo: cannot create '%s': %s\n", tmp, strerror(errno));
+		return -1;
+	}
+
+	fprintf(fp, CHECKPOINT_MAGIC "\n"
+		"position %lld\n"
+		"errors %lld\n"
+		"records %lld\n"
+		"header %d\n"
+		"output_offset %lld\n"
+		"complete %d\n",
+		ck->position, ck->errors, ck->records, ck->header,
+		ck->output_offset, ck->complete);
+
+	if (fflush(fp) == EOF || fsync(fileno(fp)) < 0) {
+		fprintf(stderr, "jpeginfo: error writing '%s': %s\n", tmp, strerror(errno));
+		fclose(fp);
+		unlink(tmp);
+		return -1;
+	}
+	fclose(fp);
+
+	if (rename(tmp, path) < 0) {
+		fprintf(stderr, "jpeginfo: cannot rename '%s': %s\n", tmp, strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* eof :-) */
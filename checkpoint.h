@@ -0,0 +1,26 @@
+/* checkpoint.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H 1
+
+#define CHECKPOINT_INTERVAL      10    /* seconds */
+#define CHECKPOINT_INTERVAL_MAX  10000 /* files */
+
+struct checkpoint {
+	long long position;       /* number of input files fully processed */
+	long long errors;         /* error count so far */
+	long long records;        /* records output so far */
+	int header;               /* header has been output */
+	long long output_offset;  /* size of output (if output is a file) */
+	int complete;             /* run has finished */
+};
+
+int checkpoint_load(const char *path, struct checkpoint *ck);
+int checkpoint_save(const char *path, const struct checkpoint *ck);
+
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,132 @@
+/* digest.c - incremental message-digest (hash) calculation
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "digest.h"
+#include "jpeginfo.h"
+
+
+/* MD5/SHA-1 implementations take (32bit) unsigned length */
+#define DIGEST_CHUNK_SIZE (1024 * 1024 * 1024)
+
+
+void digest_init(struct digest_ctx *ctx, enum hash_modes mode)
+{
+	if (!ctx)
+		return;
+
+	ctx->mode = mode;
+
+	switch (mode) {
+	case HASH_MD5:
+		MD5Init(&ctx->u.md5);
+		break;
+	case HASH_SHA1:
+		SHA1Reset(&ctx->u.sha1);
+		break;
+	case HASH_SHA256:
+		crypto_hash_sha256_init(&ctx->u.sha256);
+		break;
+	case HASH_SHA512:
+		crypto_hash_sha512_init(&ctx->u.sha512);
+		break;
+	default:
+		ctx->mode = HASH_NONE;
+	}
+}
+
+
+void digest_update(struct digest_ctx *ctx, const unsigned char *buf, size_t len)
+{
+	if (!ctx || !buf)
+		return;
+
+	while (len > 0) {
+		const size_t chunk = (len > DIGEST_CHUNK_SIZE ? DIGEST_CHUNK_SIZE : len);
+
+		switch (ctx->mode) {
+		case HASH_MD5:
+			MD5Update(&ctx->u.md5, buf, chunk);
+			break;
+		case HASH_SHA1:
+			SHA1Input(&ctx->u.sha1, buf, chunk);
+			break;
+		case HASH_SHA256:
+			crypto_hash_sha256_update(&ctx->u.sha256, buf, chunk);
+			break;
+		case HASH_SHA512:
+			crypto_hash_sha512_update(&ctx->u.sha512, buf, chunk);
+			break;
+		default:
+			return;
+		}
+		buf += chunk;
+		len -= chunk;
+	}
+}
+
+
+char *digest_final(struct digest_ctx *ctx, char *s, size_t size)
+{
+	unsigned char digest[DIGEST_MAX_SIZE];
+	unsigned int len = 0;
+
+	if (!ctx || !s || size < 1)
+		return NULL;
+
+	switch (ctx->mode) {
+	case HASH_MD5:
+		MD5Final(digest, &ctx->u.md5);
+		len = 16;
+		break;
+	case HASH_SHA1:
+		SHA1Result(&ctx->u.sha1, digest);
+		len = 20;
+		break;
+	case HASH_SHA256:
+		crypto_hash_sha256_final(&ctx->u.sha256, digest);
+		len = 32;
+		break;
+	case HASH_SHA512:
+		crypto_hash_sha512_final(&ctx->u.sha512, digest);
+		len = 64;
+		break;
+	default:
+		break;
+	}
+
+	if (size < len * 2 + 1)
+		return NULL;
+	*s = 0;
+
+	return (len > 0 ? digest2str(digest, s, len) : s);
+}
+
+/* eof :-) */
@@ -0,0 +1,40 @@
+/* digest.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef DIGEST_H
+#define DIGEST_H 1
+
+#include "md5/md5.h"
+#include "sha1/sha1.h"
+#include "sha256/crypto_hash_sha256.h"
+#include "sha512/crypto_hash_sha512.h"
+
+#define DIGEST_MAX_SIZE 64
+
+enum hash_modes {
+	HASH_NONE = 0,
+	HASH_MD5,
+	HASH_SHA1,
+	HASH_SHA256,
+	HASH_SHA512,
+};
+
+struct digest_ctx {
+	enum hash_modes mode;
+	union {
+		MD5_CTX md5;
+		SHA1Context sha1;
+		crypto_hash_sha256_state sha256;
+		crypto_hash_sha512_state sha512;
+	} u;
+};
+
+void digest_init(struct digest_ctx *ctx, enum hash_modes mode);
+void digest_update(struct digest_ctx *ctx, const unsigned char *buf, size_t len);
+char *digest_final(struct digest_ctx *ctx, char *s, size_t size);
+
+
+#endif /* DIGEST_H */
@@ -0,0 +1,173 @@
+/* filelist.c - fast reading of (large) lists of file names
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "jpeginfo.h"
+#include "filelist.h"
+
+
+/*
+ * List is read in large blocks, and names are split in place (separators
+ * replaced with NUL), so there is no per-name copying or stdio overhead.
+ * Buffer grows as needed, so there is no limit on length of the names.
+ */
+
+
+int filelist_open(struct file_list *l, const char *path, char sep)
+{
+	if (!l || !path)
+		return -1;
+
+	if (!strcmp(path, "-")) {
+		l->fd = 0;
+	} else if ((l->fd = open(path, O_RDONLY)) < 0) {
+		return -1;
+	}
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(l->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	if (!l->buf) {
+		if (!(l->buf = malloc(FILELIST_BUFFER_SIZE)))
+			no_memory();
+		l->size = FILELIST_BUFFER_SIZE;
+	}
+	l->start = l->end = 0;
+	l->sep = sep;
+	l->eof = 0;
+
+	return 0;
+}
+
+
+void filelist_close(struct file_list *l)
+{
+	if (!l)
+		return;
+
+	if (l->fd > 0)
+		close(l->fd);
+	l->fd = -1;
+	l->start = l->end = 0;
+}
+
+
+void filelist_free(struct file_list *l)
+{
+	if (!l)
+		return;
+
+	filelist_close(l);
+	free(l->buf);
+	l->buf = NULL;
+	l->size = 0;
+}
+
+
+/* Read more data into the buffer, returns 0 at end of input */
+static int fill_buffer(struct file_list *l)
+{
+	if (l->eof)
+		return 0;
+
+	if (l->start > 0) {
+		memmove(l->buf, l->buf + l->start, l->end - l->start);
+		l->end -= l->start;
+		l->start = 0;
+	}
+	if (l->end + 1 >= l->size) {
+		/* Name longer than the buffer */
+		l->size *= 2;
+		if (!(l->buf = realloc(l->buf, l->size)))
+			no_memory();
+	}
+
+	/* About to (possibly) block waiting for input, give caller chance to flush output */
+	if (l->idle)
+		l->idle();
+
+	ssize_t n;
+	do {
+		n = read(l->fd, l->buf + l->end, l->size - l->end - 1);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0) {
+		if (n < 0)
+			fprintf(stderr, "jpeginfo: error reading file list: %s\n", strerror(errno));
+		l->eof = 1;
+		return 0;
+	}
+	l->end += n;
+
+	return 1;
+}
+
+
+/*
+ * Return next name from the list, or NULL at the end of the list. Returned
+ * string is valid until next call. Empty names are skipped, and with
+ * newline separated lists trailing CR characters are removed.
+ */
+char *filelist_next(struct file_list *l)
+{
+	if (!l || l->fd < 0)
+		return NULL;
+
+	while (1) {
+		char *p = l->buf + l->start;
+		char *sep = memchr(p, l->sep, l->end - l->start);
+
+		if (!sep && !fill_buffer(l)) {
+			/* Last name may be missing the separator */
+			if (l->start >= l->end)
+				return NULL;
+			p = l->buf + l->start;
+			sep = l->buf + l->end;
+			l->end++;
+		}
+		if (!sep)
+			continue;
+
+		*sep = 0;
+		l->start = sep - l->buf + 1;
+		if (l->sep == '\n') {
+			while (sep > p && *(sep - 1) == '\r')
+				*--sep = 0;
+		}
+		if (*p)
+			return p;
+	}
+}
+
+/* eof :-) */
@@ -0,0 +1,29 @@
+/* filelist.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef FILELIST_H
+#define FILELIST_H 1
+
+#define FILELIST_BUFFER_SIZE (1024 * 1024)
+
+struct file_list {
+	int fd;
+	char *buf;
+	size_t size;
+	size_t start;
+	size_t end;
+	char sep;
+	int eof;
+	void (*idle)(void);
+};
+
+int filelist_open(struct file_list *l, const char *path, char sep);
+char *filelist_next(struct file_list *l);
+void filelist_close(struct file_list *l);
+void filelist_free(struct file_list *l);
+
+
+#endif /* FILELIST_H */
@@ -0,0 +1,358 @@
+/* filter.c - record filter expressions (--where)
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "jpeginfo.h"
+#include "format.h"
+#include "filter.h"
+
+
+/*
+ * Filter expressions are compiled into a tree of nodes (stored in an array)
+ * over the record fields. Evaluation is three-valued: fields that are not
+ * known yet (for example check status before the image has been decoded)
+ * make a comparison unknown, so an expression can be decided as early as
+ * possible (from the header only), and expensive work skipped for records
+ * that cannot match.
+ */
+
+struct parser {
+	const char *p;
+	struct filter *f;
+};
+
+static const struct {
+	const char *name;
+	enum record_field field;
+} field_aliases[] = {
+	{ "markers", FIELD_TYPE },
+	{ "depth",   FIELD_COLOR_DEPTH },
+};
+
+static const struct {
+	const char *op;
+	enum filter_cmp cmp;
+} comparisons[] = {
+	{ "==", CMP_EQ },
+	{ "!=", CMP_NE },
+	{ "<=", CMP_LE },
+	{ ">=", CMP_GE },
+	{ "!~", CMP_NOMATCH },
+	{ "<",  CMP_LT },
+	{ ">",  CMP_GT },
+	{ "~",  CMP_MATCH },
+	{ "=",  CMP_EQ },
+};
+
+#define COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+
+static int add_node(struct filter *f, int type)
+{
+	struct filter_node *nodes = realloc(f->nodes, sizeof(struct filter_node) * (f->count + 1));
+
+	if (!nodes)
+		no_memory();
+	f->nodes = nodes;
+	memset(&nodes[f->count], 0, sizeof(struct filter_node));
+	nodes[f->count].type = type;
+	nodes[f->count].left = nodes[f->count].right = -1;
+
+	return f->count++;
+}
+
+
+static void skip_space(struct parser *ps)
+{
+	while (isspace((unsigned char)*ps->p))
+		ps->p++;
+}
+
+
+static int find_field(const char *name, size_t len)
+{
+	int field = find_record_field(name, len);
+
+	for (int i = 0; field < 0 && i < COUNT(field_aliases); i++) {
+		if (strlen(field_aliases[i].name) == len
+			&& !strncmp(field_aliases[i].name, name, len))
+			field = field_aliases[i].field;
+	}
+
+	return field;
+}
+
+
+static int parse_or(struct parser *ps);
+
+/* Parse comparison (field [op value]), negation or parenthesized expression */
+static int parse_primary(struct parser *ps)
+{
+	struct filter *f = ps->f;
+
+	skip_space(ps);
+	if (*ps->p == '!' && ps->p[1] != '=' && ps->p[1] != '~') {
+		ps->p++;
+		int n = add_node(f, NODE_NOT);
+		int l = parse_primary(ps);
+		if (l < 0)
+			return -1;
+		f->nodes[n].left = l;
+		return n;
+	}
+	if (*ps->p == '(') {
+		ps->p++;
+		int n = parse_or(ps);
+		skip_space(ps);
+		if (n < 0 || *ps->p != ')')
+			return -1;
+		ps->p++;
+		return n;
+	}
+
+	const char *name = ps->p;
+	while (isalnum((unsigned char)*ps->p) || *ps->p == '_')
+		ps->p++;
+	int field = find_field(name, ps->p - name);
+	if (field < 0) {
+		ps->p = name;
+		return -1;
+	}
+	f->fields |= FIELD_MASK(field);
+
+	skip_space(ps);
+	int i;
+	for (i = 0; i < COUNT(comparisons); i++) {
+		if (!strncmp(ps->p, comparisons[i].op, strlen(comparisons[i].op)))
+			break;
+	}
+	if (i >= COUNT(comparisons)) {
+		int n = add_node(f, NODE_FIELD);
+		f->nodes[n].field = field;
+		return n;
+	}
+	enum filter_cmp cmp = comparisons[i].cmp;
+	ps->p += strlen(comparisons[i].op);
+	skip_space(ps);
+
+	/* Value is either quoted string, or runs until space or operator */
+	const char *value = ps->p;
+	size_t len;
+	if (*ps->p == '"' || *ps->p == '\'') {
+		const char *end = strchr(ps->p + 1, *ps->p);
+		if (!end)
+			return -1;
+		value = ps->p + 1;
+		len = end - value;
+		ps->p = end + 1;
+	} else {
+		while (*ps->p && !isspace((unsigned char)*ps->p) && !strchr("&|()", *ps->p))
+			ps->p++;
+		len = ps->p - value;
+	}
+
+	int n = add_node(f, NODE_COMPARE);
+	struct filter_node *node = &f->nodes[n];
+	node->field = field;
+	node->cmp = cmp;
+	if (!(node->string = strndup(value, len)))
+		no_memory();
+	if (record_fields[field].type == FIELD_NUMBER) {
+		if (cmp == CMP_MATCH || cmp == CMP_NOMATCH
+			|| parse_size(node->string, &node->number) < 0) {
+			ps->p = value;
+			return -1;
+		}
+	}
+
+	return n;
+}
+
+
+static int parse_and(struct parser *ps)
+{
+	int l = parse_primary(ps);
+
+	while (l >= 0) {
+		skip_space(ps);
+		if (ps->p[0] != '&' || ps->p[1] != '&')
+			break;
+		ps->p += 2;
+		int r = parse_primary(ps);
+		if (r < 0)
+			return -1;
+		int n = add_node(ps->f, NODE_AND);
+		ps->f->nodes[n].left = l;
+		ps->f->nodes[n].right = r;
+		l = n;
+	}
+
+	return l;
+}
+
+
+static int parse_or(struct parser *ps)
+{
+	int l = parse_and(ps);
+
+	while (l >= 0) {
+		skip_space(ps);
+		if (ps->p[0] != '|' || ps->p[1] != '|')
+			break;
+		ps->p += 2;
+		int r = parse_and(ps);
+		if (r < 0)
+			return -1;
+		int n = add_node(ps->f, NODE_OR);
+		ps->f->nodes[n].left = l;
+		ps->f->nodes[n].right = r;
+		l = n;
+	}
+
+	return l;
+}
+
+
+/*
+ * Compile expression such as "width>=4000 && !progressive && markers~ICC".
+ * Comparisons: == != < <= > >= (numbers, or strings), ~ and !~ (string
+ * contains / does not contain). Field alone is true if it is non-zero
+ * (or non-empty). Comparisons can be combined using &&, || and ! (and
+ * grouped using parenthesis).
+ */
+int filter_compile(struct filter *f, const char *expr)
+{
+	struct parser ps = { expr, f };
+
+	if (!f || !expr)
+		return -1;
+
+	memset(f, 0, sizeof(struct filter));
+	f->root = parse_or(&ps);
+	skip_space(&ps);
+	if (f->root < 0 || *ps.p) {
+		fprintf(stderr, "jpeginfo: invalid expression at '%s'\n", ps.p);
+		filter_free(f);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int eval_node(const struct filter *f, int i, const struct jpeg_info *info,
+		unsigned int known)
+{
+	const struct filter_node *n = &f->nodes[i];
+	int l, r, c;
+
+	switch (n->type) {
+	case NODE_AND:
+		if ((l = eval_node(f, n->left, info, known)) == FILTER_FALSE)
+			return FILTER_FALSE;
+		if ((r = eval_node(f, n->right, info, known)) == FILTER_FALSE)
+			return FILTER_FALSE;
+		return (l == FILTER_TRUE && r == FILTER_TRUE ? FILTER_TRUE : FILTER_UNKNOWN);
+	case NODE_OR:
+		if ((l = eval_node(f, n->left, info, known)) == FILTER_TRUE)
+			return FILTER_TRUE;
+		if ((r = eval_node(f, n->right, info, known)) == FILTER_TRUE)
+			return FILTER_TRUE;
+		return (l == FILTER_FALSE && r == FILTER_FALSE ? FILTER_FALSE : FILTER_UNKNOWN);
+	case NODE_NOT:
+		l = eval_node(f, n->left, info, known);
+		return (l == FILTER_UNKNOWN ? FILTER_UNKNOWN : !l);
+	}
+
+	if (!(known & FIELD_MASK(n->field)))
+		return FILTER_UNKNOWN;
+
+	if (record_fields[n->field].type == FIELD_NUMBER) {
+		long long v = record_number(info, n->field);
+		if (n->type == NODE_FIELD)
+			return (v != 0);
+		c = (v > n->number) - (v < n->number);
+	} else {
+		const char *s = record_string(info, n->field);
+		if (n->type == NODE_FIELD)
+			return (s[0] != 0);
+		if (n->cmp == CMP_MATCH)
+			return (strstr(s, n->string) != NULL);
+		if (n->cmp == CMP_NOMATCH)
+			return (strstr(s, n->string) == NULL);
+		c = strcmp(s, n->string);
+	}
+
+	switch (n->cmp) {
+	case CMP_EQ:
+		return (c == 0);
+	case CMP_NE:
+		return (c != 0);
+	case CMP_LT:
+		return (c < 0);
+	case CMP_LE:
+		return (c <= 0);
+	case CMP_GT:
+		return (c > 0);
+	case CMP_GE:
+		return (c >= 0);
+	}
+
+	return FILTER_UNKNOWN;
+}
+
+
+/* Evaluate filter for a record, known is mask of fields already available */
+int filter_eval(const struct filter *f, const struct jpeg_info *info, unsigned int known)
+{
+	if (!f || f->root < 0 || !info)
+		return FILTER_UNKNOWN;
+
+	return eval_node(f, f->root, info, known);
+}
+
+
+void filter_free(struct filter *f)
+{
+	if (!f)
+		return;
+
+	for (int i = 0; i < f->count; i++)
+		free(f->nodes[i].string);
+	free(f->nodes);
+	memset(f, 0, sizeof(struct filter));
+	f->root = -1;
+}
+
+/* eof :-) */
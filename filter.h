@@ -0,0 +1,55 @@
+/* filter.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef FILTER_H
+#define FILTER_H 1
+
+#define FILTER_FALSE    0
+#define FILTER_TRUE     1
+#define FILTER_UNKNOWN  (-1)
+
+enum filter_node_type {
+	NODE_AND = 0,
+	NODE_OR,
+	NODE_NOT,
+	NODE_FIELD,
+	NODE_COMPARE
+};
+
+enum filter_cmp {
+	CMP_EQ = 0,
+	CMP_NE,
+	CMP_LT,
+	CMP_LE,
+	CMP_GT,
+	CMP_GE,
+	CMP_MATCH,
+	CMP_NOMATCH
+};
+
+struct filter_node {
+	unsigned char type;
+	unsigned char cmp;
+	unsigned char field;
+	int left;
+	int right;
+	long long number;
+	char *string;
+};
+
+struct filter {
+	struct filter_node *nodes;
+	int count;
+	int root;
+	unsigned int fields;
+};
+
+int filter_compile(struct filter *f, const char *expr);
+int filter_eval(const struct filter *f, const struct jpeg_info *info, unsigned int known);
+void filter_free(struct filter *f);
+
+
+#endif /* FILTER_H */
@@ -0,0 +1,401 @@
+/* format.c - user defined output record formats
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+
+#include "jpeginfo.h"
+#include "format.h"
+
+
+/*
+ * Output format templates (--format) are compiled once into a list of
+ * operations (literal text, or a field to output with given escaping),
+ * so that formatting a record needs no parsing of the template.
+ */
+
+const struct record_field_def record_fields[FIELD_COUNT] = {
+	{ "filename",      'f', FIELD_STRING },
+	{ "size",          's', FIELD_NUMBER },
+	{ "hash",          'H', FIELD_STRING },
+	{ "width",         'w', FIELD_NUMBER },
+	{ "height",        'h', FIELD_NUMBER },
+	{ "color_depth",   'd', FIELD_NUMBER },
+	{ "type",          't', FIELD_STRING },
+	{ "mode",          'm', FIELD_STRING },
+	{ "info",          'i', FIELD_STRING },
+	{ "comments",      'c', FIELD_STRING },
+	{ "status",        'S', FIELD_STRING },
+	{ "status_detail", 'e', FIELD_STRING },
+	{ "offset",        'o', FIELD_NUMBER },
+	{ "progressive",   'P', FIELD_NUMBER },
+};
+
+static const char *escape_names[] = { "text", "raw", "json", "csv" };
+
+
+int find_record_field(const char *name, size_t len)
+{
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		if (strlen(record_fields[i].name) == len
+			&& !strncasecmp(record_fields[i].name, name, len))
+			return i;
+	}
+
+	return -1;
+}
+
+
+long long record_number(const struct jpeg_info *info, int field)
+{
+	switch (field) {
+	case FIELD_SIZE:
+		return info->size;
+	case FIELD_WIDTH:
+		return info->width;
+	case FIELD_HEIGHT:
+		return info->height;
+	case FIELD_COLOR_DEPTH:
+		return info->color_depth;
+	case FIELD_OFFSET:
+		return info->offset;
+	case FIELD_PROGRESSIVE:
+		return info->progressive;
+	default:
+		return 0;
+	}
+}
+
+
+const char *record_string(const struct jpeg_info *info, int field)
+{
+	const char *s = NULL;
+
+	switch (field) {
+	case FIELD_FILENAME:
+		s = info->filename;
+		break;
+	case FIELD_HASH:
+		s = info->digest;
+		break;
+	case FIELD_TYPE:
+		s = info->type;
+		break;
+	case FIELD_MODE:
+		s = (info->progressive ? "Progressive" : "Normal");
+		break;
+	case FIELD_INFO:
+		s = info->info;
+		break;
+	case FIELD_COMMENTS:
+		s = info->comments;
+		break;
+	case FIELD_STATUS:
+		s = check_status_str(info->check);
+		break;
+	case FIELD_STATUS_DETAIL:
+		s = info->error;
+		break;
+	default:
+		break;
+	}
+
+	return (s ? s : "");
+}
+
+
+static struct format_op *add_op(struct format_program *prog, int type)
+{
+	struct format_op *ops = realloc(prog->ops, sizeof(struct format_op) * (prog->count + 1));
+
+	if (!ops)
+		no_memory();
+	prog->ops = ops;
+
+	struct format_op *op = &ops[prog->count++];
+	memset(op, 0, sizeof(struct format_op));
+	op->type = type;
+
+	return op;
+}
+
+
+static void add_literal(struct format_program *prog, size_t *text_len, char c)
+{
+	struct format_op *op = (prog->count > 0 ? &prog->ops[prog->count - 1] : NULL);
+
+	if (!op || op->type != OP_LITERAL) {
+		op = add_op(prog, OP_LITERAL);
+		op->offset = *text_len;
+	}
+	prog->text[(*text_len)++] = c;
+	op->len++;
+}
+
+
+/*
+ * Compile template: text is output as is (with \t, \n, \r and \\ escapes),
+ * fields are given as %<letter> or %{name}, optionally followed by {arg}
+ * that selects escaping (text, raw, json, csv) for string fields, or the
+ * hash algorithm for the hash field. %% outputs single '%'.
+ */
+int format_compile(struct format_program *prog, const char *template)
+{
+	const char *p = template;
+	size_t text_len = 0;
+
+	if (!prog || !template)
+		return -1;
+
+	memset(prog, 0, sizeof(struct format_program));
+	if (!(prog->text = malloc(strlen(template) + 1)))
+		no_memory();
+
+	while (*p) {
+		if (*p == '\\') {
+			char c = 0;
+			switch (p[1]) {
+			case 't':
+				c = '\t';
+				break;
+			case 'n':
+				c = '\n';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			case '\\':
+				c = '\\';
+				break;
+			}
+			if (c) {
+				add_literal(prog, &text_len, c);
+				p += 2;
+				continue;
+			}
+		}
+		if (*p != '%') {
+			add_literal(prog, &text_len, *p++);
+			continue;
+		}
+
+		const char *start = p++;
+		int field = -1;
+
+		if (*p == '%') {
+			add_literal(prog, &text_len, *p++);
+			continue;
+		}
+		if (*p == '{') {
+			const char *end = strchr(p, '}');
+			if (end) {
+				field = find_record_field(p + 1, end - p - 1);
+				p = end + 1;
+			}
+		} else if (*p) {
+			for (int i = 0; i < FIELD_COUNT; i++) {
+				if (record_fields[i].letter == *p) {
+					field = i;
+					p++;
+					break;
+				}
+			}
+		}
+		if (field < 0)
+			goto fail;
+
+		struct format_op *op = add_op(prog, (record_fields[field].type == FIELD_NUMBER ?
+							OP_NUMBER : OP_STRING));
+		op->field = field;
+		prog->fields |= FIELD_MASK(field);
+		if (field == FIELD_HASH || field == FIELD_STATUS || field == FIELD_MODE)
+			op->escape = ESCAPE_RAW;
+
+		if (*p == '{') {
+			const char *arg = p + 1;
+			const char *end = strchr(arg, '}');
+			if (!end)
+				goto fail;
+			p = end + 1;
+
+			if (field == FIELD_HASH) {
+				free(prog->hash_name);
+				if (!(prog->hash_name = strndup(arg, end - arg)))
+					no_memory();
+				continue;
+			}
+			if (op->type != OP_STRING)
+				goto fail;
+
+			int i;
+			for (i = 0; i < sizeof(escape_names) / sizeof(escape_names[0]); i++) {
+				if (strlen(escape_names[i]) == end - arg
+					&& !strncasecmp(escape_names[i], arg, end - arg))
+					break;
+			}
+			if (i >= sizeof(escape_names) / sizeof(escape_names[0]))
+				goto fail;
+			op->escape = i;
+		}
+		continue;
+
+	fail:
+		fprintf(stderr, "jpeginfo: invalid format at '%s'\n", start);
+		format_free(prog);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Compile format that outputs given (comma separated) list of fields in
+ * the style of one of the built-in output formats. Header line (column
+ * names) for text and CSV styles is stored in prog->header.
+ */
+int format_fields(struct format_program *prog, const char *list, enum format_style style)
+{
+	static const char *separators[] = { "\\t", ",", ", ", ", " };
+	size_t size = 64 + strlen(list) * 16;
+	char *template, *header;
+	const char *p = list;
+
+	if (!prog || !list)
+		return -1;
+	if (!(template = malloc(size)) || !(header = malloc(size)))
+		no_memory();
+	template[0] = header[0] = 0;
+
+	if (style == STYLE_JSON || style == STYLE_NDJSON)
+		strncatenate(template, (style == STYLE_JSON ? " { " : "{ "), size);
+
+	while (*p) {
+		size_t len = strcspn(p, ",");
+		int field = find_record_field(p, len);
+		if (field < 0) {
+			fprintf(stderr, "jpeginfo: unknown field '%.*s'\n", (int)len, p);
+			free(template);
+			free(header);
+			return -1;
+		}
+
+		const char *name = record_fields[field].name;
+		bool string = (record_fields[field].type == FIELD_STRING);
+		char tmp[128];
+
+		if (p > list) {
+			strncatenate(template, separators[style], size);
+			strncatenate(header, (style == STYLE_CSV ? "," : "\t"), size);
+		}
+		if (style == STYLE_CSV)
+			snprintf(tmp, sizeof(tmp), (string ? "\"%%{%s}{csv}\"" : "%%{%s}"), name);
+		else if (style == STYLE_JSON || style == STYLE_NDJSON)
+			snprintf(tmp, sizeof(tmp), (string ? "\"%s\":\"%%{%s}{json}\"" : "\"%s\":%%{%s}"),
+				name, name);
+		else
+			snprintf(tmp, sizeof(tmp), "%%{%s}", name);
+		strncatenate(template, tmp, size);
+		strncatenate(header, name, size);
+
+		p += len;
+		if (*p == ',')
+			p++;
+	}
+
+	if (style == STYLE_JSON)
+		strncatenate(template, " }", size);
+	else if (style == STYLE_NDJSON)
+		strncatenate(template, " }\\n", size);
+	else
+		strncatenate(template, "\\n", size);
+	strncatenate(header, "\n", size);
+
+	int r = format_compile(prog, template);
+	free(template);
+	if (r < 0)
+		free(header);
+	else
+		prog->header = header;
+
+	return r;
+}
+
+
+/* Output record using compiled format */
+void format_run(const struct format_program *prog, struct outbuf *ob,
+		const struct jpeg_info *info)
+{
+	const struct format_op *op = prog->ops;
+
+	for (int i = 0; i < prog->count; i++, op++) {
+		switch (op->type) {
+		case OP_LITERAL:
+			outbuf_write(ob, prog->text + op->offset, op->len);
+			break;
+		case OP_NUMBER:
+			outbuf_num(ob, record_number(info, op->field), 0);
+			break;
+		case OP_STRING:
+			switch (op->escape) {
+			case ESCAPE_RAW:
+				outbuf_puts(ob, record_string(info, op->field));
+				break;
+			case ESCAPE_JSON:
+				outbuf_json(ob, record_string(info, op->field));
+				break;
+			case ESCAPE_CSV:
+				outbuf_csv(ob, record_string(info, op->field));
+				break;
+			default:
+				outbuf_text(ob, record_string(info, op->field));
+				break;
+			}
+			break;
+		}
+	}
+}
+
+
+void format_free(struct format_program *prog)
+{
+	if (!prog)
+		return;
+
+	free(prog->ops);
+	free(prog->text);
+	free(prog->hash_name);
+	free(prog->header);
+	memset(prog, 0, sizeof(struct format_program));
+}
+
+/* eof :-) */
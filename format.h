@@ -0,0 +1,94 @@
+/* format.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H 1
+
+#include "outbuf.h"
+
+enum record_field {
+	FIELD_FILENAME = 0,
+	FIELD_SIZE,
+	FIELD_HASH,
+	FIELD_WIDTH,
+	FIELD_HEIGHT,
+	FIELD_COLOR_DEPTH,
+	FIELD_TYPE,
+	FIELD_MODE,
+	FIELD_INFO,
+	FIELD_COMMENTS,
+	FIELD_STATUS,
+	FIELD_STATUS_DETAIL,
+	FIELD_OFFSET,
+	FIELD_PROGRESSIVE,
+	FIELD_COUNT
+};
+
+#define FIELD_MASK(f)  (1U << (f))
+#define FIELDS_ALL     (FIELD_MASK(FIELD_COUNT) - 1)
+
+enum field_type {
+	FIELD_STRING = 0,
+	FIELD_NUMBER
+};
+
+enum field_escape {
+	ESCAPE_TEXT = 0,
+	ESCAPE_RAW,
+	ESCAPE_JSON,
+	ESCAPE_CSV
+};
+
+struct record_field_def {
+	const char *name;
+	char letter;
+	enum field_type type;
+};
+
+enum format_style {
+	STYLE_TEXT = 0,
+	STYLE_CSV,
+	STYLE_JSON,
+	STYLE_NDJSON
+};
+
+enum format_op_type {
+	OP_LITERAL = 0,
+	OP_NUMBER,
+	OP_STRING
+};
+
+struct format_op {
+	unsigned char type;
+	unsigned char field;
+	unsigned char escape;
+	size_t offset;
+	size_t len;
+};
+
+struct format_program {
+	struct format_op *ops;
+	int count;
+	char *text;
+	char *hash_name;
+	char *header;
+	unsigned int fields;
+};
+
+extern const struct record_field_def record_fields[FIELD_COUNT];
+
+int find_record_field(const char *name, size_t len);
+long long record_number(const struct jpeg_info *info, int field);
+const char *record_string(const struct jpeg_info *info, int field);
+
+int format_compile(struct format_program *prog, const char *template);
+int format_fields(struct format_program *prog, const char *list, enum format_style style);
+void format_run(const struct format_program *prog, struct outbuf *ob,
+		const struct jpeg_info *info);
+void format_free(struct format_program *prog);
+
+
+#endif /* FORMAT_H */
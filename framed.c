@@ -0,0 +1,157 @@
+/* framed.c - length-prefixed (framed) batch input protocol
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Each input record consists of:
+ *
+ *   uint32  id length (network byte order)
+ *   uint32  data length (network byte order)
+ *   id      (id length bytes)
+ *   data    (data length bytes, JPEG image)
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "jpeginfo.h"
+#include "framed.h"
+
+
+#define FRAMED_BUFFER_SIZE (1024 * 1024)
+#define FRAMED_HEADER_SIZE 8
+
+
+void framed_reader_init(struct framed_reader *r, int fd, void (*idle)(void))
+{
+	if (!r)
+		return;
+
+	memset(r, 0, sizeof(struct framed_reader));
+	r->fd = fd;
+	r->idle = idle;
+}
+
+
+void framed_reader_free(struct framed_reader *r)
+{
+	if (!r)
+		return;
+
+	free(r->buf);
+	r->buf = NULL;
+	r->size = r->start = r->end = 0;
+}
+
+
+/* Make sure there is at least len bytes of unprocessed data in the buffer. */
+static int ensure_data(struct framed_reader *r, size_t len)
+{
+	while (r->end - r->start < len) {
+		if (r->eof)
+			return 0;
+
+		if (r->start + len > r->size) {
+			/* Move unprocessed data to beginning of the buffer */
+			if (r->start > 0) {
+				memmove(r->buf, r->buf + r->start, r->end - r->start);
+				r->end -= r->start;
+				r->start = 0;
+			}
+			if (len > r->size) {
+				size_t new_size = (r->size > 0 ? r->size : FRAMED_BUFFER_SIZE);
+				while (new_size < len)
+					new_size *= 2;
+				if (!(r->buf = realloc(r->buf, new_size)))
+					no_memory();
+				r->size = new_size;
+			}
+		}
+
+		/* About to block waiting for input, give caller chance to flush output */
+		if (r->idle)
+			r->idle();
+
+		ssize_t n = read(r->fd, r->buf + r->end, r->size - r->end);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "jpeginfo: read failed: %s\n", strerror(errno));
+			r->eof = 1;
+			return 0;
+		}
+		if (n == 0)
+			r->eof = 1;
+		r->end += n;
+	}
+
+	return 1;
+}
+
+
+static uint32_t get_uint32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+
+/*
+ * Return next record from the input. Returned pointers are valid until next call.
+ * Returns 1 if record was found, 0 on end of input, and -1 if input was invalid
+ * or truncated.
+ */
+int framed_reader_next(struct framed_reader *r, const char **id, size_t *id_len,
+		const unsigned char **data, size_t *data_len)
+{
+	if (!r || !id || !id_len || !data || !data_len)
+		return -1;
+
+	if (!ensure_data(r, FRAMED_HEADER_SIZE))
+		return (r->end > r->start ? -1 : 0);
+
+	const uint32_t ilen = get_uint32(r->buf + r->start);
+	const uint32_t dlen = get_uint32(r->buf + r->start + 4);
+	if (ilen > FRAMED_MAX_ID_LEN || dlen > FRAMED_MAX_DATA_LEN)
+		return -1;
+
+	const size_t total = FRAMED_HEADER_SIZE + ilen + dlen;
+	if (!ensure_data(r, total))
+		return -1;
+
+	*id = (const char*)r->buf + r->start + FRAMED_HEADER_SIZE;
+	*id_len = ilen;
+	*data = r->buf + r->start + FRAMED_HEADER_SIZE + ilen;
+	*data_len = dlen;
+	r->start += total;
+
+	return 1;
+}
+
+/* eof :-) */
@@ -0,0 +1,31 @@
+/* framed.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef FRAMED_H
+#define FRAMED_H 1
+
+#include <stdint.h>
+
+#define FRAMED_MAX_ID_LEN   65536
+#define FRAMED_MAX_DATA_LEN (1024 * 1024 * 1024)
+
+struct framed_reader {
+	int fd;
+	unsigned char *buf;
+	size_t size;
+	size_t start;
+	size_t end;
+	int eof;
+	void (*idle)(void);
+};
+
+void framed_reader_init(struct framed_reader *r, int fd, void (*idle)(void));
+int framed_reader_next(struct framed_reader *r, const char **id, size_t *id_len,
+		const unsigned char **data, size_t *data_len);
+void framed_reader_free(struct framed_reader *r);
+
+
+#endif /* FRAMED_H */
@@ -0,0 +1,446 @@
+/* http.c - minimal HTTP/1.1 server side protocol support
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "jpeginfo.h"
+#include "server.h"
+#include "http.h"
+
+
+#define HTTP_BUFFER_SIZE (64 * 1024)
+
+
+void http_conn_init(struct http_conn *c, int fd)
+{
+	if (!c)
+		return;
+
+	c->fd = fd;
+	c->start = c->end = 0;
+	if (!c->buf) {
+		if (!(c->buf = malloc(HTTP_BUFFER_SIZE)))
+			no_memory();
+		c->size = HTTP_BUFFER_SIZE;
+	}
+}
+
+
+void http_conn_free(struct http_conn *c)
+{
+	if (!c)
+		return;
+
+	free(c->buf);
+	c->buf = NULL;
+	c->size = c->start = c->end = 0;
+}
+
+
+/* Make sure there is at least len bytes of unprocessed data in the buffer. */
+static int ensure_data(struct http_conn *c, size_t len)
+{
+	while (c->end - c->start < len) {
+		if (c->start + len > c->size) {
+			if (c->start > 0) {
+				memmove(c->buf, c->buf + c->start, c->end - c->start);
+				c->end -= c->start;
+				c->start = 0;
+			}
+			if (len > c->size) {
+				size_t new_size = c->size;
+				while (new_size < len)
+					new_size *= 2;
+				if (!(c->buf = realloc(c->buf, new_size)))
+					no_memory();
+				c->size = new_size;
+			}
+		}
+
+		ssize_t n = read(c->fd, c->buf + c->end, c->size - c->end);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return 0;
+		c->end += n;
+	}
+
+	return 1;
+}
+
+
+/* Find end of request headers, reading more data as needed. */
+static char *find_header_end(struct http_conn *c)
+{
+	size_t searched = 0;
+
+	while (1) {
+		if (c->end - c->start >= 4) {
+			char *p = c->buf + c->start + (searched > 3 ? searched - 3 : 0);
+			char *end = c->buf + c->end;
+			while ((p = memchr(p, '\r', end - p)) && end - p >= 4) {
+				if (!memcmp(p, "\r\n\r\n", 4))
+					return p;
+				p++;
+			}
+			searched = c->end - c->start;
+		}
+		if (c->end - c->start >= HTTP_MAX_HEADER_SIZE)
+			return NULL;
+		if (!ensure_data(c, c->end - c->start + 1))
+			return NULL;
+	}
+}
+
+
+static char *trim(char *s)
+{
+	while (*s == ' ' || *s == '\t')
+		s++;
+	char *e = s + strlen(s);
+	while (e > s && (*(e - 1) == ' ' || *(e - 1) == '\t'))
+		*--e = 0;
+
+	return s;
+}
+
+
+static void send_status(int fd, int status)
+{
+	http_send_response(fd, status, "text/plain", NULL, 0, 0);
+}
+
+
+/*
+ * Read next request (line and headers) from the connection. Request body
+ * (if any) is then read using http_read_body(). Note, request strings
+ * (method, path and query) are only valid until body is read.
+ * Returns 1 when request was read, 0 if connection was closed, and -1 on
+ * invalid requests (error response has been sent).
+ */
+int http_read_request(struct http_conn *c, struct http_request *req)
+{
+	if (!c || !req)
+		return -1;
+
+	memset(req, 0, sizeof(struct http_request));
+
+	/* Skip empty lines between requests */
+	while (1) {
+		if (!ensure_data(c, 1))
+			return 0;
+		if (c->buf[c->start] != '\r' && c->buf[c->start] != '\n')
+			break;
+		c->start++;
+	}
+
+	char *hdr_end = find_header_end(c);
+	if (!hdr_end) {
+		if (c->end - c->start >= HTTP_MAX_HEADER_SIZE)
+			send_status(c->fd, 431);
+		return (c->end - c->start > 0 ? -1 : 0);
+	}
+	*hdr_end = 0;
+	size_t hdr_len = hdr_end + 4 - (c->buf + c->start);
+	char *line = c->buf + c->start;
+	char *next;
+
+	/* Request line */
+	if ((next = strstr(line, "\r\n")))
+		*next = 0;
+	char *method = strtok(line, " ");
+	char *target = strtok(NULL, " ");
+	char *version = strtok(NULL, " ");
+	if (!method || !target || !version || strncmp(version, "HTTP/1.", 7)) {
+		send_status(c->fd, 400);
+		return -1;
+	}
+	req->method = method;
+	req->path = target;
+	if ((req->query = strchr(target, '?')))
+		*req->query++ = 0;
+	req->keep_alive = (strcmp(version, "HTTP/1.0") != 0);
+
+	/* Headers */
+	long long content_length = -1;
+	int expect_continue = 0;
+	while (next) {
+		line = next + 2;
+		if ((next = strstr(line, "\r\n")))
+			*next = 0;
+		char *val = strchr(line, ':');
+		if (!val)
+			continue;
+		*val++ = 0;
+		val = trim(val);
+
+		if (!strcasecmp(line, "Content-Length")) {
+			char *e;
+			content_length = strtoll(val, &e, 10);
+			if (*e || content_length < 0) {
+				send_status(c->fd, 400);
+				return -1;
+			}
+		}
+		else if (!strcasecmp(line, "Connection")) {
+			if (!strcasecmp(val, "close"))
+				req->keep_alive = 0;
+			else if (!strcasecmp(val, "keep-alive"))
+				req->keep_alive = 1;
+		}
+		else if (!strcasecmp(line, "Transfer-Encoding")) {
+			send_status(c->fd, 501);
+			return -1;
+		}
+		else if (!strcasecmp(line, "Expect")) {
+			if (strcasecmp(val, "100-continue")) {
+				send_status(c->fd, 417);
+				return -1;
+			}
+			expect_continue = 1;
+		}
+	}
+
+	if (content_length < 0) {
+		if (!strcmp(method, "POST") || !strcmp(method, "PUT")) {
+			send_status(c->fd, 411);
+			return -1;
+		}
+		content_length = 0;
+	}
+	if (content_length > HTTP_MAX_BODY_SIZE) {
+		send_status(c->fd, 413);
+		return -1;
+	}
+
+	if (expect_continue) {
+		const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+		write_all(c->fd, cont, strlen(cont));
+	}
+
+	req->content_length = req->body_left = content_length;
+	c->start += hdr_len;
+
+	return 1;
+}
+
+
+/*
+ * Return next chunk of the request body as it arrives. Returned data is
+ * valid until next call. Returns 1 when data was returned, 0 at the end
+ * of the body, and -1 if connection was closed (or timed out).
+ */
+int http_read_body(struct http_conn *c, struct http_request *req,
+		const unsigned char **data, size_t *len)
+{
+	if (!c || !req || !data || !len)
+		return -1;
+	if (req->body_left == 0)
+		return 0;
+
+	if (c->start == c->end) {
+		c->start = c->end = 0;
+		if (!ensure_data(c, 1))
+			return -1;
+	}
+
+	size_t n = c->end - c->start;
+	if (n > req->body_left)
+		n = req->body_left;
+	*data = (unsigned char*)c->buf + c->start;
+	*len = n;
+	c->start += n;
+	req->body_left -= n;
+
+	return 1;
+}
+
+
+/* Skip (rest of) the request body, returns -1 if connection was lost. */
+int http_discard_body(struct http_conn *c, struct http_request *req)
+{
+	const unsigned char *data;
+	size_t len;
+	int r;
+
+	while ((r = http_read_body(c, req, &data, &len)) > 0)
+		;
+
+	return r;
+}
+
+
+/*
+ * Close connection after response was sent without reading the request
+ * body: stop sending and read (and discard) whatever the client still sends
+ * for a while, so that the connection is not reset before client has
+ * received the response.
+ */
+void http_lingering_close(int fd)
+{
+	char buf[16 * 1024];
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	long long deadline = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + HTTP_LINGER_TIME;
+
+	shutdown(fd, SHUT_WR);
+	while (1) {
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		long long left = deadline - ((long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+		if (left <= 0)
+			break;
+
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		int r = poll(&pfd, 1, left);
+		if (r < 0 && errno != EINTR)
+			break;
+		if (r > 0 && read(fd, buf, sizeof(buf)) <= 0)
+			break;
+	}
+}
+
+
+static const char *status_text(int status)
+{
+	switch (status) {
+	case 100: return "Continue";
+	case 200: return "OK";
+	case 400: return "Bad Request";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 411: return "Length Required";
+	case 413: return "Payload Too Large";
+	case 417: return "Expectation Failed";
+	case 422: return "Unprocessable Entity";
+	case 431: return "Request Header Fields Too Large";
+	case 501: return "Not Implemented";
+	}
+
+	return "Error";
+}
+
+
+int http_send_response(int fd, int status, const char *content_type,
+		const char *body, size_t len, int keep_alive)
+{
+	char hdr[512];
+
+	if (!body) {
+		body = status_text(status);
+		len = strlen(body);
+	}
+
+	int hdr_len = snprintf(hdr, sizeof(hdr),
+			"HTTP/1.1 %d %s\r\n"
+			"Content-Type: %s\r\n"
+			"Content-Length: %lu\r\n"
+			"Connection: %s\r\n"
+			"\r\n",
+			status, status_text(status),
+			(content_type ? content_type : "text/plain"),
+			(unsigned long)len,
+			(keep_alive ? "keep-alive" : "close"));
+
+	/* Send headers and (small) body with a single write */
+	if (hdr_len + len <= sizeof(hdr) * 8) {
+		char out[sizeof(hdr) * 8];
+		memcpy(out, hdr, hdr_len);
+		memcpy(out + hdr_len, body, len);
+		return write_all(fd, out, hdr_len + len);
+	}
+
+	if (write_all(fd, hdr, hdr_len) < 0)
+		return -1;
+	return write_all(fd, body, len);
+}
+
+
+static int hexval(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	return tolower(c) - 'a' + 10;
+}
+
+
+static void url_decode(char *s)
+{
+	char *o = s;
+
+	while (*s) {
+		if (*s == '%' && isxdigit(s[1]) && isxdigit(s[2])) {
+			*o++ = (hexval(s[1]) << 4) | hexval(s[2]);
+			s += 3;
+		} else if (*s == '+') {
+			*o++ = ' ';
+			s++;
+		} else {
+			*o++ = *s++;
+		}
+	}
+	*o = 0;
+}
+
+
+/* Return next (URL decoded) key=value pair from query string */
+char *http_next_param(char **query, char **val)
+{
+	char *key;
+
+	if (!query || !*query || !val)
+		return NULL;
+
+	do {
+		key = *query;
+		if (!key || !*key)
+			return NULL;
+		if ((*query = strchr(key, '&')))
+			*(*query)++ = 0;
+	} while (!*key);
+
+	if ((*val = strchr(key, '=')))
+		*(*val)++ = 0;
+	else
+		*val = key + strlen(key);
+	url_decode(key);
+	url_decode(*val);
+
+	return key;
+}
+
+/* eof :-) */
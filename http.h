@@ -0,0 +1,46 @@
+/* http.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef HTTP_H
+#define HTTP_H 1
+
+#include <stddef.h>
+
+#define HTTP_MAX_HEADER_SIZE (16 * 1024)
+#define HTTP_MAX_BODY_SIZE   (256 * 1024 * 1024)
+#define HTTP_IDLE_TIMEOUT    10
+#define HTTP_LINGER_TIME     2000
+
+struct http_conn {
+	int fd;
+	char *buf;
+	size_t size;
+	size_t start;
+	size_t end;
+};
+
+struct http_request {
+	char *method;
+	char *path;
+	char *query;
+	int keep_alive;
+	size_t content_length;
+	size_t body_left;
+};
+
+void http_conn_init(struct http_conn *c, int fd);
+void http_conn_free(struct http_conn *c);
+int http_read_request(struct http_conn *c, struct http_request *req);
+int http_read_body(struct http_conn *c, struct http_request *req,
+		const unsigned char **data, size_t *len);
+int http_discard_body(struct http_conn *c, struct http_request *req);
+int http_send_response(int fd, int status, const char *content_type,
+		const char *body, size_t len, int keep_alive);
+void http_lingering_close(int fd);
+char *http_next_param(char **query, char **val);
+
+
+#endif /* HTTP_H */
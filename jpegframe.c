@@ -0,0 +1,207 @@
+/* jpegframe.c - split stream of concatenated JPEG images into frames
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jpeginfo.h"
+#include "jpegframe.h"
+
+
+#define FRAME_READ_SIZE (256 * 1024)
+
+#define M_SOI 0xd8
+#define M_EOI 0xd9
+#define M_SOS 0xda
+
+
+void frame_reader_init(struct frame_reader *r, FILE *infile)
+{
+	if (!r)
+		return;
+
+	memset(r, 0, sizeof(struct frame_reader));
+	r->infile = infile;
+}
+
+
+void frame_reader_free(struct frame_reader *r)
+{
+	if (!r)
+		return;
+
+	free(r->buf);
+	r->buf = NULL;
+	r->size = r->start = r->end = 0;
+}
+
+
+/* Make sure buffer contains data up to (but not including) given position. */
+static int ensure_data(struct frame_reader *r, size_t pos)
+{
+	while (r->end < pos) {
+		if (r->eof)
+			return 0;
+
+		if (r->size - r->end < FRAME_READ_SIZE) {
+			if (r->start > 0 && r->start >= r->size / 2) {
+				/* Discard already processed data */
+				memmove(r->buf, r->buf + r->start, r->end - r->start);
+				r->offset += r->start;
+				pos -= r->start;
+				r->end -= r->start;
+				r->start = 0;
+				continue;
+			}
+			r->size = (r->size > 0 ? r->size * 2 : FRAME_READ_SIZE * 4);
+			if (!(r->buf = realloc(r->buf, r->size)))
+				no_memory();
+		}
+
+		size_t len = fread(r->buf + r->end, 1, r->size - r->end, r->infile);
+		if (len == 0)
+			r->eof = 1;
+		r->end += len;
+	}
+
+	return 1;
+}
+
+
+/* Find next 0xFF byte at or after pos, returns -1 if end of input reached. */
+static long long find_ff(struct frame_reader *r, size_t pos)
+{
+	while (1) {
+		if (pos >= r->end) {
+			size_t rel = pos - r->start;
+			if (!ensure_data(r, pos + 1))
+				return -1;
+			pos = r->start + rel;
+		}
+		unsigned char *p = memchr(r->buf + pos, 0xff, r->end - pos);
+		if (p)
+			return p - r->buf;
+		pos = r->end;
+	}
+}
+
+
+/*
+ * Return next frame (from SOI to EOI) found in the input. Frame boundaries are
+ * located by walking through marker segments and using memchr() to scan
+ * over entropy coded data. Frame is valid until next call.
+ */
+int frame_reader_next(struct frame_reader *r, const unsigned char **frame,
+		size_t *len, long long *offset)
+{
+	long long ff;
+
+	if (!r || !frame || !len)
+		return -1;
+
+	/* Locate start of image (SOI) marker */
+	while (1) {
+		if ((ff = find_ff(r, r->start)) < 0) {
+			r->skipped += r->end - r->start;
+			r->start = r->end;
+			return 0;
+		}
+		r->skipped += ff - r->start;
+		r->start = ff;
+		if (!ensure_data(r, r->start + 2)) {
+			r->skipped += r->end - r->start;
+			r->start = r->end;
+			return 0;
+		}
+		if (r->buf[r->start + 1] == M_SOI)
+			break;
+		r->start++;
+		r->skipped++;
+	}
+
+	/* Scan frame, keeping positions relative to frame start since
+	   buffer may get moved when more data is read in. */
+	size_t pos = 2;
+	int entropy = 0;
+	int complete = 0;
+
+	while (1) {
+		if (entropy) {
+			if ((ff = find_ff(r, r->start + pos)) < 0)
+				break;
+			pos = ff - r->start;
+		}
+		if (!ensure_data(r, r->start + pos + 2))
+			break;
+
+		unsigned char *p = r->buf + r->start + pos;
+		if (p[0] != 0xff) {
+			/* Garbage where marker was expected, search for next marker */
+			entropy = 1;
+			continue;
+		}
+
+		unsigned char m = p[1];
+		if (m == 0x00 || m == 0xff || (m >= 0xd0 && m <= 0xd7) || m == 0x01) {
+			/* Stuffed zero, fill byte, RSTn or TEM */
+			pos += (m == 0xff ? 1 : 2);
+			continue;
+		}
+		if (m == M_EOI) {
+			pos += 2;
+			complete = 1;
+			break;
+		}
+		if (m == M_SOI) {
+			/* Truncated frame, next one starts here */
+			break;
+		}
+
+		/* Marker segment with length field */
+		if (!ensure_data(r, r->start + pos + 4))
+			break;
+		p = r->buf + r->start + pos;
+		size_t seglen = (p[2] << 8) | p[3];
+		pos += 2 + seglen;
+		entropy = (m == M_SOS);
+	}
+
+	if (!complete && r->start + pos > r->end)
+		pos = r->end - r->start;
+
+	*frame = r->buf + r->start;
+	*len = pos;
+	if (offset)
+		*offset = r->offset + r->start;
+	r->start += pos;
+
+	return 1;
+}
+
+/* eof :-) */
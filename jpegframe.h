@@ -0,0 +1,29 @@
+/* jpegframe.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef JPEGFRAME_H
+#define JPEGFRAME_H 1
+
+#include <stdio.h>
+
+struct frame_reader {
+	FILE *infile;
+	unsigned char *buf;
+	size_t size;		/* allocated size of buf */
+	size_t start;		/* start of unprocessed data in buf */
+	size_t end;		/* end of data in buf */
+	long long offset;	/* input stream offset of buf[0] */
+	long long skipped;	/* bytes skipped between frames */
+	int eof;
+};
+
+void frame_reader_init(struct frame_reader *r, FILE *infile);
+int frame_reader_next(struct frame_reader *r, const unsigned char **frame,
+		size_t *len, long long *offset);
+void frame_reader_free(struct frame_reader *r);
+
+
+#endif /* JPEGFRAME_H */
@@ -34,24 +34,53 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <setjmp.h>
+#include <stdarg.h>
 #include <ctype.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include <jpeglib.h>
 #include <jerror.h>
 
-#include "md5/md5.h"
-#include "sha1/sha1.h"
-#include "sha256/crypto_hash_sha256.h"
-#include "sha512/crypto_hash_sha512.h"
+#include "digest.h"
 #include "jpegmarker.h"
+#include "jpegstream.h"
+#include "jpegframe.h"
+#include "jpegpush.h"
+#include "framed.h"
+#include "server.h"
+#include "http.h"
+#include "pool.h"
+#include "checkpoint.h"
+#include "shard.h"
 #include "jpeginfo.h"
+#include "queue.h"
+#include "filelist.h"
+#include "sample.h"
+#include "budget.h"
+#include "arena.h"
+#include "outbuf.h"
+#include "format.h"
+#include "filter.h"
+#include "sink.h"
+#include "arrow.h"
 
 
 #define VERSION     "1.7.2beta"
 #define COPYRIGHT   "Copyright (C) 1996-2025 Timo Kokkonen"
 
 #define BUF_LINES   512
+#define DECODE_OVERHEAD (1024 * 1024)
+#define HEADER_BUFFER_SIZE 4096
+#define MAX_OUTPUTS 16
+#define HEADER_FIELDS (FIELDS_ALL & ~(FIELD_MASK(FIELD_HASH) | FIELD_MASK(FIELD_STATUS) | \
+					FIELD_MASK(FIELD_STATUS_DETAIL)))
 
 #ifndef HOST_TYPE
 #define HOST_TYPE ""
@@ -63,34 +92,39 @@ struct my_error_mgr {
 };
 typedef struct my_error_mgr * my_error_ptr;
 
-static struct jpeg_decompress_struct cinfo;
-static struct my_error_mgr jerr;
-
-struct jpeg_info {
-	int width;
-	int height;
-	int color_depth;
-	int progressive;
-	int check;
-	size_t size;
-	char *filename;
-	char *type;;
-	char *info;
-	char *comments;
-	char *digest;
-	char *error;
+struct my_progress_mgr {
+	struct jpeg_progress_mgr pub;
+	long long time_limit;
 };
 
-enum hash_modes {
-	HASH_NONE = 0,
-	HASH_MD5,
-	HASH_SHA1,
-	HASH_SHA256,
-	HASH_SHA512,
-};
+static struct jpeg_decompress_struct cinfo;
+static struct my_error_mgr jerr;
+static struct my_progress_mgr progress;
+static int abort_status = 0;
+
+static struct jpeg_info info;
+static struct arena record_arena;
+static struct format_program record_format;
+static struct filter where_filter;
+static bool record_skipped = false;
+static struct jpeg_stream_source stream_src;
+static struct digest_ctx digest;
+static JSAMPROW line_buffer[BUF_LINES];
+static JSAMPLE *line_buffer_mem = NULL;
+static size_t line_buffer_width = 0;
+static long line_buffer_allocs = 0;
+static JOCTET *stream_buffer = NULL;
+static size_t stream_buffer_size = STREAM_BUFFER_SIZE;
+static bool stream_active = false;
+static struct jpeg_push_source push_src;
+static enum { STAGE_HEADER, STAGE_START, STAGE_SCAN, STAGE_FINISH, STAGE_DONE } push_stage;
 
 FILE *infile=NULL;
-FILE *listfile=NULL;
+char **list_sources = NULL;
+int list_source_count = 0;
+int list_source_index = 0;
+static struct file_list input_list = { .fd = -1 };
+bool null_mode = false;
 int global_error_counter = 0;
 int global_total_errors = 0;
 int verbose_mode = 0;
@@ -107,12 +141,66 @@ enum hash_modes hash_mode = HASH_NONE;
 int stdin_mode = 0;
 bool csv_mode = false;
 bool json_mode = false;
+bool ndjson_mode = false;
+bool arrow_mode = false;
+bool feather_mode = false;
+char *format_template = NULL;
+char *field_list = NULL;
+char *where_expr = NULL;
+char *out_specs[MAX_OUTPUTS];
+int out_count = 0;
+long long min_size = -1;
+long long max_size = -1;
+bool format_mode = false;
 bool header_mode = false;
 int files_stdin_mode = 0;
+int stream_mode = 0;
+int frames_mode = 0;
+int framed_mode = 0;
 char *current = NULL;
 char last_error[JMSG_LENGTH_MAX + 1];
-char escape_char = 0;
-char escape_val = 0;
+char *watch_dir = NULL;
+int watch_delay = 250;
+bool flush_mode = false;
+volatile sig_atomic_t stop_requested = 0;
+char *daemon_socket = NULL;
+char *client_socket = NULL;
+char *http_address = NULL;
+int worker_count = 0;
+long long worker_mem = 0;
+char **arg_values = NULL;
+int shard_index = 0;
+int shard_count = 0;
+bool shard_by_size = false;
+char *queue_dir = NULL;
+int queue_add_mode = 0;
+int queue_lease = QUEUE_DEFAULT_LEASE;
+size_t batch_size = QUEUE_DEFAULT_BATCH;
+static struct work_queue *active_queue = NULL;
+char *checkpoint_file = NULL;
+static struct checkpoint ckpt;
+static long long checkpoint_skip = 0;
+static time_t ckpt_last_save = 0;
+static long ckpt_unsaved = 0;
+double sample_rate = 0.0;
+unsigned long long sample_seed = 0;
+enum sample_strata sample_strata = STRATA_NONE;
+static struct sampler sampler;
+int tiered_mode = 0;
+int http_public = 0;
+static bool tier_check = false;
+long file_timeout = 0;
+int max_scans = 0;
+double deadline = 0.0;
+static long long run_deadline = 0;
+static bool deadline_reached = false;
+static bool deadline_cut = false;
+long long max_pixels = 0;
+long long max_memory = 0;
+static struct mem_budget *mem_budget = NULL;
+int huge_pages_mode = 0;
+int stats_mode = 0;
+static long stats_records = 0;
 
 
 static struct option long_options[] = {
@@ -133,10 +221,48 @@ static struct option long_options[] = {
 	{"comments",0,0,'C'},
 	{"csv",0,0,'s'},
 	{"json",0,0,'j'},
+	{"ndjson",0,0,'F'},
+	{"arrow",0,0,'a'},
+	{"format",1,0,'I'},
+	{"fields",1,0,'g'},
+	{"where",1,0,'w'},
+	{"min-size",1,0,'k'},
+	{"max-size",1,0,'x'},
+	{"out",1,0,'y'},
 	{"header",0,0,'H'},
 	{"stdin",0,&stdin_mode,1},
+	{"stream",0,&stream_mode,1},
+	{"frames",0,&frames_mode,1},
+	{"framed",0,&framed_mode,1},
 	{"files-from",1,0,'f'},
 	{"files-stdin",0,&files_stdin_mode,1},
+	{"null",0,0,'0'},
+	{"watch",1,0,'W'},
+	{"watch-delay",1,0,'D'},
+	{"daemon",1,0,'X'},
+	{"client",1,0,'Y'},
+	{"workers",1,0,'P'},
+	{"worker-mem",1,0,'M'},
+	{"shard",1,0,'S'},
+	{"shard-by",1,0,'B'},
+	{"queue",1,0,'Q'},
+	{"queue-add",0,&queue_add_mode,1},
+	{"batch-size",1,0,'N'},
+	{"lease",1,0,'L'},
+	{"checkpoint",1,0,'K'},
+	{"sample",1,0,'A'},
+	{"sample-by",1,0,'G'},
+	{"seed",1,0,'E'},
+	{"tiered",0,&tiered_mode,1},
+	{"http-public",0,&http_public,1},
+	{"file-timeout",1,0,'O'},
+	{"max-scans",1,0,'U'},
+	{"deadline",1,0,'Z'},
+	{"max-pixels",1,0,'R'},
+	{"max-memory",1,0,'J'},
+	{"huge-pages",0,&huge_pages_mode,1},
+	{"stats",0,&stats_mode,1},
+	{"http",1,0,'T'},
 	{0,0,0,0}
 };
 
@@ -146,11 +272,140 @@ static struct option long_options[] = {
 static void my_error_exit (j_common_ptr cinfo)
 {
 	my_error_ptr myerr = (my_error_ptr)cinfo->err;
+
+	/* Decoding needs more memory than allowed (--max-memory) */
+	if (cinfo->err->msg_code == JERR_NO_BACKING_STORE && max_memory > 0)
+		abort_status = 6;
 	(*cinfo->err->output_message) (cinfo);
 	longjmp(myerr->setjmp_buffer,1);
 }
 
 
+/* Abort decoding with given status (through the error handler) */
+static void abort_decode(int status, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(last_error, sizeof(last_error), fmt, args);
+	va_end(args);
+	abort_status = status;
+	global_total_errors++;
+	longjmp(jerr.setjmp_buffer, 1);
+}
+
+
+/*
+ * Abort decoding because the run deadline was reached. File is left for the
+ * next run: it is not output, counted as an error, nor included in checkpoint.
+ */
+static void abort_deadline(void)
+{
+	deadline_reached = deadline_cut = true;
+	abort_status = 5;
+	longjmp(jerr.setjmp_buffer, 1);
+}
+
+
+/* Current time (monotonic) in nanoseconds */
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+static void periodic_flush(void);
+
+
+/* Abort decoding (through error handler) if time or scan limit is exceeded */
+static void my_progress_monitor(j_common_ptr cinfo)
+{
+	struct my_progress_mgr *prog = (struct my_progress_mgr*)cinfo->progress;
+	int scans = ((j_decompress_ptr)cinfo)->input_scan_number;
+
+	/* Keep lease of the batch alive also while decoding a slow image */
+	if (active_queue)
+		queue_touch(active_queue);
+	/* ...and streamed output moving while decoding a slow image */
+	periodic_flush();
+	if (max_scans > 0 && scans > max_scans)
+		abort_decode(6, "Too many scans (limit %d)", max_scans);
+	if (prog->time_limit > 0 && now_ns() > prog->time_limit) {
+		if (run_deadline > 0 && prog->time_limit >= run_deadline)
+			abort_deadline();
+		abort_decode(5, "Time limit exceeded");
+	}
+}
+
+
+/* Start time and scan limits (and batch lease updates, output flushing) for the next image */
+static void progress_start(void)
+{
+	abort_status = 0;
+	periodic_flush();
+	if (!file_timeout && !max_scans && !run_deadline && !active_queue &&
+			!ndjson_mode && !out_count)
+		return;
+
+	progress.pub.progress_monitor = my_progress_monitor;
+	progress.time_limit = (file_timeout > 0 ? now_ns() + file_timeout * 1000000LL : 0);
+	if (run_deadline > 0 && (!progress.time_limit || progress.time_limit > run_deadline))
+		progress.time_limit = run_deadline;
+	cinfo.progress = &progress.pub;
+}
+
+
+/* Estimate memory needed to decode (check) current image */
+static long long decode_memory(j_decompress_ptr cinfo, long long input_size)
+{
+	bool multiscan = jpeg_has_multiple_scans(cinfo);
+	long long coef = 0;
+
+	for (int ci = 0; ci < cinfo->num_components; ci++) {
+		jpeg_component_info *comp = &cinfo->comp_info[ci];
+		long long w = ((long long)cinfo->image_width * comp->h_samp_factor +
+			cinfo->max_h_samp_factor * DCTSIZE - 1) /
+			(cinfo->max_h_samp_factor * DCTSIZE);
+		long long h = ((long long)cinfo->image_height * comp->v_samp_factor +
+			cinfo->max_v_samp_factor * DCTSIZE - 1) /
+			(cinfo->max_v_samp_factor * DCTSIZE);
+
+		/* Multi-scan images need coefficients for the whole image */
+		coef += w * (multiscan ? h : comp->v_samp_factor) * DCTSIZE2 * sizeof(JCOEF);
+	}
+
+	return coef + (long long)BUF_LINES * ((cinfo->image_width + 7) / 8) +
+		input_size + DECODE_OVERHEAD;
+}
+
+
+/* Check image size and memory needed against limits before decoding */
+static void check_decode_limits(long long input_size)
+{
+	long long pixels = (long long)cinfo.image_width * cinfo.image_height;
+
+	if (max_pixels > 0 && pixels > max_pixels)
+		abort_decode(6, "Image too large (%lld pixels, limit %lld)",
+			pixels, max_pixels);
+	if (max_memory < 1)
+		return;
+
+	long long need = decode_memory(&cinfo, input_size);
+	int r = budget_acquire(mem_budget, need, progress.time_limit);
+	if (r == -1)
+		abort_decode(6, "Image needs too much memory (%lld MB, limit %lld MB)",
+			(need + (1 << 20) - 1) >> 20, max_memory >> 20);
+	if (r == -2) {
+		if (run_deadline > 0 && progress.time_limit >= run_deadline)
+			abort_deadline();
+		abort_decode(5, "Time limit exceeded (waiting for memory)");
+	}
+}
+
+
 static void my_output_message (j_common_ptr cinfo)
 {
 	char buffer[JMSG_LENGTH_MAX + 1];
@@ -210,6 +465,7 @@ void print_usage(void)
 		"  -f <filename>,  --files-from=<filename>\n"
 		"                  Read the filenames to process from given file\n"
 		"   --files-stdin  Read the filenames to process from standard input\n"
+		"  -0, --null      Filenames in the list(s) are separated by NUL characters\n"
 		"  -h, --help      Display this help and exit\n"
 		"  -H, --header    Display column name header in output\n"
 		"  -i, --info      Display even more information about pictures\n"
@@ -227,26 +483,83 @@ void print_usage(void)
 		"  -V, --version	  Print program version and exit\n"
 		"\n"
 		"   -, --stdin     Read input from standard input (instead of a file)\n"
+		"  --stream        Stream input through fixed size buffer (constant memory use)\n"
+		"  --frames        Input is a stream of concatenated JPEGs (MJPEG), check each frame\n"
+		"  --ndjson        Newline delimited JSON output (one object per line)\n"
+		"  --arrow         Apache Arrow IPC stream output (binary, columnar)\n"
+		"  --format=<fmt>  Output records using given template (for example '%%f\\t%%w\\t%%h\\n')\n"
+		"  --fields=<list> Output only given (comma separated) fields, for example\n"
+		"                  filename,width,height (only work needed for them is done)\n"
+		"  --where=<expr>  Output only files matching expression, for example\n"
+		"                  'width>=4000 && !progressive && markers~ICC'\n"
+		"  --min-size=<n>  Skip files smaller than <n> bytes (suffixes k, M, G)\n"
+		"  --max-size=<n>  Skip files larger than <n> bytes (suffixes k, M, G)\n"
+		"  --out=<format>:<file>\n"
+		"                  Write output in given format (text, csv, json, ndjson,\n"
+		"                  list, arrow, feather) into file ('-' for stdout), can be\n"
+		"                  given multiple times\n"
+		"  --framed        Read length-prefixed (id, image) records from standard input\n"
+		"  --watch=<dir>   Stay running and check new files as they appear in <dir>\n"
+		"  --watch-delay=<ms>\n"
+		"                  Wait until file has been idle for <ms> (default 250)\n"
+		"  --daemon=<socket>\n"
+		"                  Run as a server answering requests over UNIX socket\n"
+		"  --client=<socket>\n"
+		"                  Process files using server running at <socket>\n"
+		"  --http=<addr:port>\n"
+		"                  Run as a HTTP server answering POST /check requests\n"
+		"  --http-public   Allow --http to listen on other than loopback address\n"
+		"  --workers=<n>   Number of worker processes to use\n"
+		"  --worker-mem=<MB>\n"
+		"                  Limit memory (address space) of each worker process\n"
+		"  --shard=<i/N>   Process only i:th of N (disjoint) parts of the input files\n"
+		"  --shard-by=<hash|size>\n"
+		"                  Assign files to shards by path hash (default) or size\n"
+		"  --queue=<dir>   Process batches from a work queue shared with other instances\n"
+		"  --queue-add     Add input files into the work queue (see --queue)\n"
+		"  --batch-size=<n>\n"
+		"                  Number of files per batch when adding into the queue\n"
+		"  --lease=<sec>   Time after which unfinished batches are reclaimed\n"
+		"  --checkpoint=<file>\n"
+		"                  Save progress into <file> and resume from it if it exists\n"
+		"  --sample=<rate> Check only a random sample of the input files and estimate\n"
+		"                  error rates for all files (rate: 0.01, 1%% or 1/100)\n"
+		"  --sample-by=<none|dir|size>\n"
+		"                  Stratify sample by directory or file size class\n"
+		"  --seed=<n>      Seed for selecting the sample (default 0)\n"
+		"  --tiered        List (header) information of all files first, then check\n"
+		"                  the files and output updated records\n"
+		"  --file-timeout=<ms>\n"
+		"                  Stop checking a file after <ms> (status TIMEOUT)\n"
+		"  --max-scans=<n> Stop checking a file with more than <n> scans (status LIMIT)\n"
+		"  --deadline=<sec>\n"
+		"                  Do not start processing new files after <sec> seconds\n"
+		"  --max-pixels=<n>\n"
+		"                  Do not check images larger than <n> pixels (status LIMIT)\n"
+		"  --max-memory=<MB>\n"
+		"                  Memory budget for decoding (shared by all workers)\n"
+		"  --huge-pages    Use transparent huge pages for large decoding buffers\n"
+		"  --stats         Print (memory allocation) statistics at exit\n"
 		"\n\n");
 
 	exit(0);
 }
 
 
-void print_hash_header()
+void print_hash_header(FILE *out)
 {
 	switch (hash_mode) {
 	case HASH_MD5:
-		printf("MD5                              ");
+		fprintf(out, "MD5                              ");
 		break;
 	case HASH_SHA1:
-		printf("SHA-1                                    ");
+		fprintf(out, "SHA-1                                    ");
 		break;
 	case HASH_SHA256:
-		printf("SHA-256                                                          ");
+		fprintf(out, "SHA-256                                                          ");
 		break;
 	case HASH_SHA512:
-		printf("SHA-512                                                          "
+		fprintf(out, "SHA-512                                                          "
 			"                                                                ");
 		break;
 
@@ -256,11 +569,58 @@ void print_hash_header()
 }
 
 
+const char *hash_mode_name(enum hash_modes mode)
+{
+	switch (mode) {
+	case HASH_MD5:
+		return "md5";
+	case HASH_SHA1:
+		return "sha1";
+	case HASH_SHA256:
+		return "sha256";
+	case HASH_SHA512:
+		return "sha512";
+	default:
+		break;
+	}
+
+	return "none";
+}
+
+
+int parse_hash_mode(const char *name, enum hash_modes *mode)
+{
+	static const enum hash_modes modes[] = {
+		HASH_NONE, HASH_MD5, HASH_SHA1, HASH_SHA256, HASH_SHA512
+	};
+
+	for (int i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		if (!strcasecmp(name, hash_mode_name(modes[i]))) {
+			*mode = modes[i];
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+
+/* Add file (containing list of files to process) as an input source */
+static void add_list_source(const char *name)
+{
+	list_sources = realloc(list_sources, sizeof(char*) * (list_source_count + 1));
+	if (!list_sources)
+		no_memory();
+	list_sources[list_source_count++] = (char*)name;
+	input_from_file = true;
+}
+
+
 void parse_args(int argc, char **argv)
 {
 	while(1) {
 		opt_index=0;
-		const int c = getopt_long(argc,argv, "livVdcChqm:f:521sHj",
+		const int c = getopt_long(argc,argv, "livVdcChqm:f:521sHj0",
 					  long_options, &opt_index);
 		if (c == -1)
 			break;
@@ -272,15 +632,10 @@ void parse_args(int argc, char **argv)
 				fprintf(stderr, "Unknown parameter for -m, --mode.\n");
 			break;
 		case 'f':
-			if (verbose_mode)
-				fprintf(stderr, "Reading input filenames from: '%s'\n", optarg);
-			if (!strcmp(optarg, "-"))
-				listfile = stdin;
-			else if ((listfile = fopen(optarg, "r")) == NULL) {
-				fprintf(stderr, "Cannot open file '%s'.\n", optarg);
-				exit(2);
-			}
-			input_from_file = true;
+			add_list_source(optarg);
+			break;
+		case '0':
+			null_mode = true;
 			break;
 		case 'v':
 			verbose_mode++;
@@ -324,9 +679,161 @@ void parse_args(int argc, char **argv)
 		case 'j':
 			json_mode = true;
 			break;
+		case 'F':
+			json_mode = true;
+			ndjson_mode = true;
+			break;
+		case 'a':
+			arrow_mode = true;
+			break;
+		case 'I':
+			format_template = optarg;
+			break;
+		case 'g':
+			field_list = optarg;
+			break;
+		case 'w':
+			where_expr = optarg;
+			break;
+		case 'k':
+			if (parse_size(optarg, &min_size) < 0) {
+				fprintf(stderr, "Invalid parameter for --min-size.\n");
+				exit(1);
+			}
+			break;
+		case 'x':
+			if (parse_size(optarg, &max_size) < 0) {
+				fprintf(stderr, "Invalid parameter for --max-size.\n");
+				exit(1);
+			}
+			break;
+		case 'y':
+			if (out_count >= MAX_OUTPUTS) {
+				fprintf(stderr, "jpeginfo: too many outputs (max %d)\n", MAX_OUTPUTS);
+				exit(1);
+			}
+			out_specs[out_count++] = optarg;
+			break;
 		case 'H':
 			header_mode = true;
 			break;
+		case 'W':
+			watch_dir = optarg;
+			break;
+		case 'D':
+			watch_delay = atoi(optarg);
+			if (watch_delay < 0)
+				watch_delay = 0;
+			break;
+		case 'X':
+			daemon_socket = optarg;
+			break;
+		case 'Y':
+			client_socket = optarg;
+			break;
+		case 'M':
+			worker_mem = atoll(optarg) * 1024 * 1024;
+			if (worker_mem < 1) {
+				fprintf(stderr, "Invalid parameter for --worker-mem.\n");
+				exit(1);
+			}
+			break;
+		case 'S':
+			if (parse_shard(optarg, &shard_index, &shard_count) < 0) {
+				fprintf(stderr, "Invalid parameter for --shard (i/N expected).\n");
+				exit(1);
+			}
+			break;
+		case 'B':
+			if (!strcasecmp(optarg, "size"))
+				shard_by_size = true;
+			else if (!strcasecmp(optarg, "hash"))
+				shard_by_size = false;
+			else {
+				fprintf(stderr, "Invalid parameter for --shard-by.\n");
+				exit(1);
+			}
+			break;
+		case 'Q':
+			queue_dir = optarg;
+			break;
+		case 'N':
+			if (atol(optarg) < 1) {
+				fprintf(stderr, "Invalid parameter for --batch-size.\n");
+				exit(1);
+			}
+			batch_size = atol(optarg);
+			break;
+		case 'L':
+			queue_lease = atoi(optarg);
+			if (queue_lease < 1) {
+				fprintf(stderr, "Invalid parameter for --lease.\n");
+				exit(1);
+			}
+			break;
+		case 'K':
+			checkpoint_file = optarg;
+			break;
+		case 'A':
+			if (parse_sample_rate(optarg, &sample_rate) < 0) {
+				fprintf(stderr, "Invalid parameter for --sample.\n");
+				exit(1);
+			}
+			break;
+		case 'G':
+			if (parse_sample_strata(optarg, &sample_strata) < 0) {
+				fprintf(stderr, "Invalid parameter for --sample-by.\n");
+				exit(1);
+			}
+			break;
+		case 'E':
+			sample_seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'O':
+			file_timeout = atol(optarg);
+			if (file_timeout < 1) {
+				fprintf(stderr, "Invalid parameter for --file-timeout.\n");
+				exit(1);
+			}
+			break;
+		case 'U':
+			max_scans = atoi(optarg);
+			if (max_scans < 1) {
+				fprintf(stderr, "Invalid parameter for --max-scans.\n");
+				exit(1);
+			}
+			break;
+		case 'R':
+			max_pixels = atoll(optarg);
+			if (max_pixels < 1) {
+				fprintf(stderr, "Invalid parameter for --max-pixels.\n");
+				exit(1);
+			}
+			break;
+		case 'J':
+			max_memory = atoll(optarg) * 1024 * 1024;
+			if (max_memory < 1) {
+				fprintf(stderr, "Invalid parameter for --max-memory.\n");
+				exit(1);
+			}
+			break;
+		case 'Z':
+			deadline = atof(optarg);
+			if (!(deadline > 0)) {
+				fprintf(stderr, "Invalid parameter for --deadline.\n");
+				exit(1);
+			}
+			break;
+		case 'T':
+			http_address = optarg;
+			break;
+		case 'P':
+			worker_count = atoi(optarg);
+			if (worker_count < 1) {
+				fprintf(stderr, "Invalid parameter for --workers.\n");
+				exit(1);
+			}
+			break;
 		case '?':
 			exit(1);
 
@@ -341,30 +848,98 @@ void parse_args(int argc, char **argv)
 		i++;
 	}
 
-	if (files_stdin_mode) {
-		listfile = stdin;
-		input_from_file = true;
+	if (files_stdin_mode)
+		add_list_source("-");
+
+	if (sample_rate > 0) {
+		if (frames_mode) {
+			fprintf(stderr, "jpeginfo: --sample cannot be used with --frames\n");
+			exit(1);
+		}
+		/* Estimating error rates requires checking the files */
+		check_mode = true;
+		sampler_init(&sampler, sample_rate, sample_seed, sample_strata);
+	}
+
+	if (where_expr && filter_compile(&where_filter, where_expr) < 0)
+		exit(1);
+
+	if (format_template && field_list) {
+		fprintf(stderr, "jpeginfo: --format and --fields cannot be used together\n");
+		exit(1);
+	}
+	if (format_template) {
+		if (format_compile(&record_format, format_template) < 0)
+			exit(1);
+		if (record_format.hash_name) {
+			enum hash_modes mode;
+			if (parse_hash_mode(record_format.hash_name, &mode) < 0 || mode == HASH_NONE) {
+				fprintf(stderr, "jpeginfo: unknown hash algorithm '%s' in format\n",
+					record_format.hash_name);
+				exit(1);
+			}
+			if (hash_mode != HASH_NONE && hash_mode != mode) {
+				fprintf(stderr, "jpeginfo: format uses different hash algorithm than "
+					"other options (only one can be used)\n");
+				exit(1);
+			}
+			hash_mode = mode;
+		}
+		csv_mode = json_mode = ndjson_mode = list_mode = false;
+		format_mode = true;
+	}
+	else if (field_list) {
+		enum format_style style = (ndjson_mode ? STYLE_NDJSON : (json_mode ? STYLE_JSON :
+						(csv_mode ? STYLE_CSV : STYLE_TEXT)));
+		if (format_fields(&record_format, field_list, style) < 0)
+			exit(1);
+		format_mode = true;
+	}
+	/* Do not calculate hash that is not going to be output */
+	if (format_mode && !((record_format.fields | where_filter.fields) & FIELD_MASK(FIELD_HASH)))
+		hash_mode = HASH_NONE;
+
+	if (arrow_mode && (format_mode || daemon_socket || http_address || queue_dir
+				|| checkpoint_file)) {
+		fprintf(stderr, "jpeginfo: --arrow cannot be used with --format, --fields, "
+			"--daemon, --http, --queue or --checkpoint\n");
+		exit(1);
+	}
+	if (arrow_mode)
+		csv_mode = json_mode = ndjson_mode = list_mode = false;
+	if (out_count > 0) {
+		if (format_mode || daemon_socket || http_address || queue_dir || checkpoint_file) {
+			fprintf(stderr, "jpeginfo: --out cannot be used with --format, --fields, "
+				"--daemon, --http, --queue or --checkpoint\n");
+			exit(1);
+		}
+	}
+
+	if (checkpoint_file) {
+		/* Output written after checkpoint can only be discarded from a file */
+		struct stat st;
+		if (fstat(fileno(stdout), &st) < 0 || !S_ISREG(st.st_mode)) {
+			fprintf(stderr, "jpeginfo: --checkpoint requires output to be "
+				"redirected into a file\n");
+			exit(1);
+		}
+	}
+
+	if (tiered_mode && (frames_mode || checkpoint_file)) {
+		fprintf(stderr, "jpeginfo: --tiered cannot be used with --frames or --checkpoint\n");
+		exit(1);
 	}
 
 	if (delete_mode && verbose_mode && !quiet_mode)
 		fprintf(stderr, "jpeginfo: delete mode enabled (%s)\n",
 			(!del_mode ? "normal" : "errors only"));
 
-	if (argc <= optind && !input_from_file) {
+	if (argc <= optind && !input_from_file && !watch_dir && !framed_mode
+		&& !daemon_socket && !http_address && !(queue_dir && !queue_add_mode)) {
 		if (quiet_mode < 2) fprintf(stderr, "jpeginfo: file arguments missing\n"
 					"Try 'jpeginfo --help' for more information.\n");
 		exit(1);
 	}
-
-	if (csv_mode) {
-		escape_char = '"';
-		escape_val = '"';
-
-	}
-	else if (json_mode) {
-		escape_char = '"';
-		escape_val = '\\';
-	}
 }
 
 
@@ -377,25 +952,77 @@ void clear_jpeg_info(struct jpeg_info *info)
 }
 
 
+/* Allocate memory for the current record (freed by free_jpeg_info()) */
+void *record_alloc(size_t size)
+{
+	void *p = arena_alloc(&record_arena, size);
+	if (!p)
+		no_memory();
+	return p;
+}
+
+
+char *record_strndup(const char *s, size_t len)
+{
+	char *str = record_alloc(len + 1);
+
+	memcpy(str, s, len);
+	str[len] = 0;
+	return str;
+}
+
+
+char *record_strdup(const char *s)
+{
+	return (s ? record_strndup(s, strlen(s)) : NULL);
+}
+
+
 void free_jpeg_info(struct jpeg_info *info)
 {
 	if (!info)
 		return;
 
-	if (info->filename)
-		free(info->filename);
-	if (info->type)
-		free(info->type);
-	if (info->info)
-		free(info->info);
-	if (info->comments)
-		free(info->comments);
-	if (info->digest)
-		free(info->digest);
-	if (info->error)
-		free(info->error);
-
+	/* All strings of the record are allocated from the record arena */
+	arena_reset(&record_arena);
 	clear_jpeg_info(info);
+	record_skipped = false;
+}
+
+
+/* Return mask of the (record) fields current output format needs */
+static unsigned int needed_fields(void)
+{
+	unsigned int fields = FIELDS_ALL;
+
+	if (out_count > 0) {
+		/* Outputs may use different formats */
+		fields = FIELDS_ALL;
+	}
+	else if (format_mode) {
+		fields = record_format.fields;
+	}
+	else if (!csv_mode && !json_mode && !arrow_mode) {
+		if (!com_mode)
+			fields &= ~FIELD_MASK(FIELD_COMMENTS);
+		if (!longinfo_mode)
+			fields &= ~FIELD_MASK(FIELD_INFO);
+	}
+
+	return fields | where_filter.fields;
+}
+
+
+/* Save markers (for the record) only if output needs them */
+static void setup_marker_saving(void)
+{
+	const unsigned int marker_fields = FIELD_MASK(FIELD_TYPE) | FIELD_MASK(FIELD_COMMENTS);
+	const unsigned int limit = ((needed_fields() & marker_fields) || verbose_mode ? 0xffff : 0);
+
+	jpeg_save_markers(&cinfo, JPEG_COM, limit);
+	for (int j = 0; j < 16; j++) {
+		jpeg_save_markers(&cinfo, JPEG_APP0 + j, limit);
+	}
 }
 
 
@@ -404,18 +1031,17 @@ void parse_jpeg_info(struct jpeg_decompress_struct *cinfo, struct jpeg_info *inf
 	if (!cinfo || !info)
 		return;
 
-	const size_t marker_types = jpeg_special_marker_types_count();
-
-	char *seen = malloc(marker_types);
-	if (seen == NULL)
-		no_memory();
-	memset(seen, 0, marker_types);
+	const unsigned int fields = needed_fields();
 
 	info->width = (int)cinfo->image_width;
 	info->height = (int)cinfo->image_height;
 	info->color_depth = (int)cinfo->num_components * 8;
 	info->progressive = (cinfo->progressive_mode ? 1 : 0);
 
+	/* Markers are saved only when needed (see setup_marker_saving()) */
+	if (!cinfo->marker_list && !(fields & FIELD_MASK(FIELD_INFO)))
+		return;
+
 	char info_str[256];
 	strncopy(info_str, (cinfo->arith_code ? "Arithmetic" : "Huffman"), sizeof(info_str));
 	char comment_str[1024];
@@ -425,6 +1051,10 @@ void parse_jpeg_info(struct jpeg_decompress_struct *cinfo, struct jpeg_info *inf
 
 	/* Check for special (Exif/IPTC/ICC/XMP/etc...) markers */
 	jpeg_saved_marker_ptr cmarker=cinfo->marker_list;
+	const size_t marker_types = jpeg_special_marker_types_count();
+	char *seen = (cmarker ? record_alloc(marker_types) : NULL);
+	if (seen)
+		memset(seen, 0, marker_types);
 
 	int marker_in_count = 0;
 	int comment_count = 0;
@@ -452,14 +1082,9 @@ void parse_jpeg_info(struct jpeg_decompress_struct *cinfo, struct jpeg_info *inf
 			if (cmarker->data_length > 0) {
 				int o = 0;
 				char tmp[64];
-				for (int i = 0; i < cmarker->data_length; i++) {
-					char ch = cmarker->data[i];
-					if (!isprint(ch)) {
-						ch = '.';
-					}
-					if (o < sizeof(tmp) - 1) {
-						*(tmp + o++) = ch;
-					}
+				for (int i = 0; i < cmarker->data_length && o < sizeof(tmp) - 1; i++) {
+					unsigned char ch = cmarker->data[i];
+					tmp[o++] = (ch >= 0x20 && ch < 0x7f ? ch : '.');
 				}
 				*(tmp + o) = 0;
 
@@ -484,22 +1109,25 @@ void parse_jpeg_info(struct jpeg_decompress_struct *cinfo, struct jpeg_info *inf
 	if (unknown_count > 0)
 		str_add_list(marker_str, sizeof(marker_str), "UNKNOWN", ",");
 
-	if (cinfo->density_unit == 1 || cinfo->density_unit == 2) {
-		char tmp[9];
-		snprintf(tmp, sizeof(tmp), "%ddp%c", MIN(cinfo->X_density, cinfo->Y_density),
-			(cinfo->density_unit == 1 ? 'i' : 'c') );
-		str_add_list(info_str, sizeof(marker_str), tmp, ",");
-	}
+	if (fields & FIELD_MASK(FIELD_INFO)) {
+		if (cinfo->density_unit == 1 || cinfo->density_unit == 2) {
+			char tmp[9];
+			snprintf(tmp, sizeof(tmp), "%ddp%c", MIN(cinfo->X_density, cinfo->Y_density),
+				(cinfo->density_unit == 1 ? 'i' : 'c') );
+			str_add_list(info_str, sizeof(marker_str), tmp, ",");
+		}
 
-	if (cinfo->CCIR601_sampling) {
-		str_add_list(info_str, sizeof(marker_str), "CCIR601", ",");
-	}
+		if (cinfo->CCIR601_sampling) {
+			str_add_list(info_str, sizeof(marker_str), "CCIR601", ",");
+		}
 
-	info->type = strdup(marker_str);
-	info->info = strdup(info_str);
-	info->comments = strdup(comment_str);
+		info->info = record_strdup(info_str);
+	}
 
-	free(seen);
+	if (fields & FIELD_MASK(FIELD_TYPE))
+		info->type = record_strdup(marker_str);
+	if (fields & FIELD_MASK(FIELD_COMMENTS))
+		info->comments = record_strdup(comment_str);
 }
 
 
@@ -512,63 +1140,177 @@ const char *check_status_str(int check)
 		return "WARNING";
 	case 3:
 		return "ERROR";
+	case 4:
+		return "CRASH";
+	case 5:
+		return "TIMEOUT";
+	case 6:
+		return "LIMIT";
 	}
 
 	return "";
 }
 
 
-void print_jpeg_info(struct jpeg_info *info)
+/* Options that can be changed per request (in daemon mode) */
+struct request_options {
+	bool check_mode;
+	bool com_mode;
+	bool longinfo_mode;
+	bool csv_mode;
+	bool json_mode;
+	bool ndjson_mode;
+	bool arrow_mode;
+	bool feather_mode;
+	bool format_mode;
+	bool list_mode;
+	enum hash_modes hash_mode;
+};
+
+static void save_request_options(struct request_options *o)
 {
-	if (!info)
-		return;
+	o->check_mode = check_mode;
+	o->com_mode = com_mode;
+	o->longinfo_mode = longinfo_mode;
+	o->csv_mode = csv_mode;
+	o->json_mode = json_mode;
+	o->ndjson_mode = ndjson_mode;
+	o->arrow_mode = arrow_mode;
+	o->feather_mode = feather_mode;
+	o->format_mode = format_mode;
+	o->list_mode = list_mode;
+	o->hash_mode = hash_mode;
+}
 
-	if (quiet_mode > 1)
-		return;
 
-	static int header_printed = 0;
-	static long line =  0;
+static void restore_request_options(const struct request_options *o)
+{
+	check_mode = o->check_mode;
+	com_mode = o->com_mode;
+	longinfo_mode = o->longinfo_mode;
+	csv_mode = o->csv_mode;
+	json_mode = o->json_mode;
+	ndjson_mode = o->ndjson_mode;
+	arrow_mode = o->arrow_mode;
+	feather_mode = o->feather_mode;
+	format_mode = o->format_mode;
+	list_mode = o->list_mode;
+	hash_mode = o->hash_mode;
+}
+
 
-	if ((header_mode || json_mode) && !header_printed) {
-		if (csv_mode) {
-			printf("filename,size,hash,width,height,color_depth,markers,progressive_normal,extra_info,comments,status,status_detail\n");
+int set_output_format(const char *format)
+{
+	csv_mode = json_mode = ndjson_mode = list_mode = format_mode = false;
+	arrow_mode = feather_mode = false;
+
+	if (!strcasecmp(format, "json"))
+		json_mode = true;
+	else if (!strcasecmp(format, "ndjson"))
+		json_mode = ndjson_mode = true;
+	else if (!strcasecmp(format, "csv"))
+		csv_mode = true;
+	else if (!strcasecmp(format, "arrow"))
+		arrow_mode = true;
+	else if (!strcasecmp(format, "feather"))
+		arrow_mode = feather_mode = true;
+	else if (!strcasecmp(format, "list"))
+		list_mode = true;
+	else if (strcasecmp(format, "text"))
+		return -1;
+
+	return 0;
+}
+
+
+static int header_printed = 0;
+static long records_printed = 0;
+static struct outbuf record_out;
+static FILE *outfile = NULL;
+static struct arrow_writer main_arrow;
+static struct arrow_writer *arrow_out = &main_arrow;
+
+/* Additional outputs (--out), each with its own format and output state */
+struct output_sink {
+	struct sink sink;
+	struct request_options options;
+	struct arrow_writer arrow;
+	int header_printed;
+	long records_printed;
+};
+
+static struct output_sink sinks[MAX_OUTPUTS];
+static int sink_count = 0;
+
+
+/* Arrow output cannot be resumed after a failed write (stream would be corrupt) */
+static void arrow_failed(void)
+{
+	fprintf(stderr, "jpeginfo: error writing Arrow output: %s\n", strerror(errno));
+	exit(2);
+}
+
+void print_header(FILE *out)
+{
+	if ((header_mode || json_mode || arrow_mode) && !header_printed) {
+		if (arrow_mode) {
+			if (arrow_begin(arrow_out, out, feather_mode) < 0)
+				arrow_failed();
+		}
+		else if (format_mode) {
+			if (json_mode && !ndjson_mode)
+				fprintf(out, "[\n");
+			else if (header_mode && record_format.header)
+				fputs(record_format.header, out);
+		}
+		else if (csv_mode) {
+			fprintf(out, "filename,size,hash,width,height,color_depth,markers,progressive_normal,extra_info,comments,status,status_detail%s\n",
+				(frames_mode ? ",offset" : ""));
 		}
 		else if (json_mode) {
-			printf("[\n");
+			if (!ndjson_mode)
+				fprintf(out, "[\n");
 		}
 		else if (list_mode) {
-			printf("  W  x  H   Color P Markers                  ");
+			fprintf(out, "  W  x  H   Color P Markers                  ");
 			if (longinfo_mode)
-				printf("ExtraInfo            ");
-			printf("   Size ");
-			print_hash_header();
+				fprintf(out, "ExtraInfo            ");
+			if (frames_mode)
+				fprintf(out, "    Offset ");
+			fprintf(out, "   Size ");
+			print_hash_header(out);
 			if (com_mode)
-				printf("Comments                         ");
-			printf("Filename                         ");
+				fprintf(out, "Comments                         ");
+			fprintf(out, "Filename                         ");
 			if (check_mode)
-				printf("Status  Details");
-			printf("\n");
+				fprintf(out, "Status  Details");
+			fprintf(out, "\n");
 		}
 		else {
-			printf("Filename                           W  x  H   Color P Markers                  ");
+			fprintf(out, "Filename                           W  x  H   Color P Markers                  ");
 			if (longinfo_mode)
-				printf("ExtraInfo            ");
-			printf("   Size ");
-			print_hash_header();
+				fprintf(out, "ExtraInfo            ");
+			if (frames_mode)
+				fprintf(out, "    Offset ");
+			fprintf(out, "   Size ");
+			print_hash_header(out);
 			if (com_mode)
-				printf("Comments                         ");
+				fprintf(out, "Comments                         ");
 			if (check_mode)
-				printf("Status  Details");
-			printf("\n");
+				fprintf(out, "Status  Details");
+			fprintf(out, "\n");
 		}
 		header_printed = 1;
 	}
+}
+
 
-	char *filename = escape_str(info->filename, escape_char, escape_val);
-	char *com = (info->comments ? info->comments : "");
+/* Format single record (JSON records are formatted without newline) */
+static void format_jpeg_record(struct outbuf *ob, struct jpeg_info *info)
+{
+	const char *com = (info->comments ? info->comments : "");
 	if (!com_mode && !csv_mode && !json_mode)
 		com = "";
-	com = escape_str(com, escape_char, escape_val);
 	const char *type = (info->type ? info->type : "");
 	const char *einfo = (info->info ? info->info : "");
 	const char *error = (info->error ? info->error : "");
@@ -576,289 +1318,1893 @@ void print_jpeg_info(struct jpeg_info *info)
 
 	const char p = (info->progressive ? 'P' : 'N');
 
-	line++;
-
-	if (csv_mode) {
-		printf("\"%s\",%lu,\"%s\",%d,%d,\"%dbit\",\"%s\",\"%c\",\"%s\",\"%s\",\"%s\",\"%s\"\n",
-			filename,
-			(long unsigned int)info->size,
-			digest,
-			info->width,
-			info->height,
-			info->color_depth,
-			type,
-			p,
-			einfo,
-			com,
-			check_status_str(info->check),
-			error
-			);
+	if (format_mode) {
+		format_run(&record_format, ob, info);
+	}
+	else if (csv_mode) {
+		outbuf_putc(ob, '"');
+		outbuf_csv(ob, info->filename);
+		outbuf_puts(ob, "\",");
+		outbuf_num(ob, info->size, 0);
+		outbuf_puts(ob, ",\"");
+		outbuf_puts(ob, digest);
+		outbuf_puts(ob, "\",");
+		outbuf_num(ob, info->width, 0);
+		outbuf_putc(ob, ',');
+		outbuf_num(ob, info->height, 0);
+		outbuf_puts(ob, ",\"");
+		outbuf_num(ob, info->color_depth, 0);
+		outbuf_puts(ob, "bit\",\"");
+		outbuf_csv(ob, type);
+		outbuf_puts(ob, "\",\"");
+		outbuf_putc(ob, p);
+		outbuf_puts(ob, "\",\"");
+		outbuf_csv(ob, einfo);
+		outbuf_puts(ob, "\",\"");
+		outbuf_csv(ob, com);
+		outbuf_puts(ob, "\",\"");
+		outbuf_puts(ob, check_status_str(info->check));
+		outbuf_puts(ob, "\",\"");
+		outbuf_csv(ob, error);
+		outbuf_putc(ob, '"');
+		if (frames_mode) {
+			outbuf_putc(ob, ',');
+			outbuf_num(ob, info->offset, 0);
+		}
+		outbuf_putc(ob, '\n');
 	}
 	else if (json_mode) {
-		if (line > 1)
-			printf(",\n");
-		printf(" { \"filename\":\"%s\", \"size\":%lu, \"hash\":\"%s\", \"width\":%d, \"height\":%d,"
-			" \"color_depth\":\"%dbit\", \"type\":\"%s\", \"mode\":\"%s\", \"info\":\"%s\","
-			" \"comments\":\"%s\", \"status\":\"%s\", \"status_detail\":\"%s\" }",
-			filename,
-			(long unsigned int)info->size,
-			digest,
-			info->width,
-			info->height,
-			info->color_depth,
-			type,
-			(p == 'P' ? "Progressive" : "Normal"),
-			einfo,
-			com,
-			check_status_str(info->check),
-			error
-			);
-	}
-	else if (list_mode) {
-		printf("%4d x %4d %2dbit %c %-24s ",
-			info->width,
-			info->height,
-			info->color_depth,
-			p,
-			type);
-		if (longinfo_mode)
-			printf("%-20s ", einfo);
-		printf("%7lu ",
-			(long unsigned int)info->size);
-		if (info->digest)
-			printf("%s ", digest);
-		if (com_mode)
-			printf("%-32s ", com);
-		printf("%-32s %-7s%s%s\n",
-			filename,
-			check_status_str(info->check),
-			(info->error ? " " : ""),
-			error
-			);
+		outbuf_puts(ob, (ndjson_mode ? "{ \"filename\":\"" : " { \"filename\":\""));
+		outbuf_json(ob, info->filename);
+		outbuf_puts(ob, "\", ");
+		if (frames_mode) {
+			outbuf_puts(ob, "\"offset\":");
+			outbuf_num(ob, info->offset, 0);
+			outbuf_puts(ob, ", ");
+		}
+		outbuf_puts(ob, "\"size\":");
+		outbuf_num(ob, info->size, 0);
+		outbuf_puts(ob, ", \"hash\":\"");
+		outbuf_puts(ob, digest);
+		outbuf_puts(ob, "\", \"width\":");
+		outbuf_num(ob, info->width, 0);
+		outbuf_puts(ob, ", \"height\":");
+		outbuf_num(ob, info->height, 0);
+		outbuf_puts(ob, ", \"color_depth\":\"");
+		outbuf_num(ob, info->color_depth, 0);
+		outbuf_puts(ob, "bit\", \"type\":\"");
+		outbuf_json(ob, type);
+		outbuf_puts(ob, "\", \"mode\":\"");
+		outbuf_puts(ob, (p == 'P' ? "Progressive" : "Normal"));
+		outbuf_puts(ob, "\", \"info\":\"");
+		outbuf_json(ob, einfo);
+		outbuf_puts(ob, "\", \"comments\":\"");
+		outbuf_json(ob, com);
+		outbuf_puts(ob, "\", \"status\":\"");
+		outbuf_puts(ob, check_status_str(info->check));
+		outbuf_puts(ob, "\", \"status_detail\":\"");
+		outbuf_json(ob, error);
+		outbuf_puts(ob, (ndjson_mode ? "\" }\n" : "\" }"));
 	}
 	else {
-		printf("%-32s %4d x %4d %2dbit %c %-24s ",
-			filename,
-			info->width,
-			info->height,
-			info->color_depth,
-			p,
-			type);
-		if (longinfo_mode)
-			printf("%-20s ", einfo);
-		printf("%7lu ",
-			(long unsigned int)info->size);
-		if (info->digest)
-			printf("%s ", digest);
-		if (com_mode)
-			printf("%-32s ", com);
-		printf("%-7s%s%s\n",
-			check_status_str(info->check),
-			(info->error ? " " : ""),
-			error
-			);
+		if (!list_mode) {
+			outbuf_pad(ob, info->filename, 32);
+			outbuf_putc(ob, ' ');
+		}
+		outbuf_num(ob, info->width, 4);
+		outbuf_puts(ob, " x ");
+		outbuf_num(ob, info->height, 4);
+		outbuf_putc(ob, ' ');
+		outbuf_num(ob, info->color_depth, 2);
+		outbuf_puts(ob, "bit ");
+		outbuf_putc(ob, p);
+		outbuf_putc(ob, ' ');
+		outbuf_pad(ob, type, 24);
+		outbuf_putc(ob, ' ');
+		if (longinfo_mode) {
+			outbuf_pad(ob, einfo, 20);
+			outbuf_putc(ob, ' ');
+		}
+		if (frames_mode) {
+			outbuf_num(ob, info->offset, 10);
+			outbuf_putc(ob, ' ');
+		}
+		outbuf_num(ob, info->size, 7);
+		outbuf_putc(ob, ' ');
+		if (info->digest) {
+			outbuf_puts(ob, digest);
+			outbuf_putc(ob, ' ');
+		}
+		if (com_mode) {
+			outbuf_pad(ob, com, 32);
+			outbuf_putc(ob, ' ');
+		}
+		if (list_mode) {
+			outbuf_pad(ob, info->filename, 32);
+			outbuf_putc(ob, ' ');
+		}
+		outbuf_pad(ob, check_status_str(info->check), 7);
+		if (info->error) {
+			outbuf_putc(ob, ' ');
+			outbuf_puts(ob, error);
+		}
+		outbuf_putc(ob, '\n');
 	}
-
-
-	if (filename)
-		free(filename);
-	if (com)
-		free(com);
 }
 
 
-void clear_line_buffer(JSAMPARRAY buf)
+/* Print out single record (JSON records are printed without newline) */
+void print_jpeg_record(FILE *out, struct jpeg_info *info)
 {
-	for (int i = 0; i < BUF_LINES; i++) {
-		if (buf[i])
-			free(buf[i]);
-		buf[i] = NULL;
+	if (arrow_mode) {
+		if (arrow_append(arrow_out, info, out) < 0)
+			arrow_failed();
+		return;
 	}
+	format_jpeg_record(&record_out, info);
+	outbuf_flush(&record_out, out);
 }
 
 
-char* calculate_hash(const unsigned char *buf, size_t buf_len)
+/* Start new output (file), header etc. are printed again */
+void begin_output(FILE *out)
 {
-	unsigned char digest[64];
-	char digest_text[128 + 1];
-	MD5_CTX md5;
-	SHA1Context sha1;
+	outfile = out;
+	header_printed = 0;
+	records_printed = 0;
+}
 
-	switch(hash_mode) {
-	case HASH_MD5:
-		MD5Init(&md5);
-		MD5Update(&md5, buf, buf_len);
-		MD5Final(digest, &md5);
-		digest2str(digest, digest_text, 16);
-		break;
-	case HASH_SHA1:
-		SHA1Reset(&sha1);
-		SHA1Input(&sha1, buf, buf_len);
-		SHA1Result(&sha1, digest);
-		digest2str(digest, digest_text, 20);
-		break;
-	case HASH_SHA256:
-		crypto_hash_sha256(digest, buf, buf_len);
-		digest2str(digest, digest_text, 32);
-		break;
-	case HASH_SHA512:
-		crypto_hash_sha512(digest, buf, buf_len);
-		digest2str(digest, digest_text, 64);
-		break;
-	default:
-		digest_text[0] = 0;
-	}
 
-	return strdup(digest_text);
+/* Begin output of a new record (print header and/or record separator) */
+void begin_record(void)
+{
+	print_header(outfile);
+	if (json_mode && !ndjson_mode && ++records_printed > 1)
+		outbuf_write(&record_out, ",\n", 2);
 }
 
 
-/*****************************************************************************/
-int main(int argc, char **argv)
+/* Switch output state (format, header, record count) to given sink */
+static void select_sink(struct output_sink *s)
 {
-	char namebuf[MAXPATHLEN + 1];
-	JSAMPROW line_buffer[BUF_LINES];
-	JSAMPARRAY buf = line_buffer;
-	unsigned char *inbuf = NULL;
-	long long file_size;
-	size_t inbuffer_size;
+	restore_request_options(&s->options);
+	outfile = s->sink.fp;
+	arrow_out = &s->arrow;
+	header_printed = s->header_printed;
+	records_printed = s->records_printed;
+}
 
-	/* Initialize memory structures... */
-	for(int i = 0; i < BUF_LINES; i++) {
-		buf[i] = NULL;
+
+static void deselect_sink(struct output_sink *s)
+{
+	s->header_printed = header_printed;
+	s->records_printed = records_printed;
+}
+
+
+void print_jpeg_info(struct jpeg_info *info)
+{
+	if (!info)
+		return;
+
+	if (quiet_mode > 1)
+		return;
+
+	if (sink_count > 0) {
+		/* Same record is formatted for each output */
+		struct request_options saved;
+		FILE *saved_out = outfile;
+
+		save_request_options(&saved);
+		for (int i = 0; i < sink_count; i++) {
+			select_sink(&sinks[i]);
+			begin_record();
+			print_jpeg_record(outfile, info);
+			deselect_sink(&sinks[i]);
+		}
+		restore_request_options(&saved);
+		outfile = saved_out;
+		arrow_out = &main_arrow;
+		return;
 	}
-	struct jpeg_info info;
-	clear_jpeg_info(&info);
-	cinfo.err = jpeg_std_error(&jerr.pub);
-	jpeg_create_decompress(&cinfo);
-	jerr.pub.error_exit=my_error_exit;
-	jerr.pub.output_message=my_output_message;
 
-	/* Parse command line parameters */
-	parse_args(argc, argv);
-	int i=(optind > 0 ? optind : 1);
+	begin_record();
+	print_jpeg_record(outfile, info);
+}
+
+
+void end_output(void)
+{
+	if (arrow_mode) {
+		print_header(outfile);
+		if (arrow_finish(arrow_out, outfile) < 0 || fflush(outfile) == EOF)
+			arrow_failed();
+	}
+	else if (json_mode && !ndjson_mode) {
+		print_header(outfile);
+		fprintf(outfile, "\n]\n");
+	}
+}
+
+
+/* Open outputs given using --out (format:file) */
+static int open_sinks(void)
+{
+	struct request_options saved;
+	int r = 0;
+
+	save_request_options(&saved);
+	for (int i = 0; i < out_count && r == 0; i++) {
+		char format[16];
+		const char *path = strchr(out_specs[i], ':');
+
+		if (!path || path - out_specs[i] >= sizeof(format)) {
+			fprintf(stderr, "jpeginfo: invalid output '%s' (format:file expected)\n",
+				out_specs[i]);
+			r = -1;
+			break;
+		}
+		strncopy(format, out_specs[i], path - out_specs[i] + 1);
+		path++;
+		if (set_output_format(format) < 0) {
+			fprintf(stderr, "jpeginfo: unknown output format '%s'\n", format);
+			r = -1;
+			break;
+		}
+
+		struct output_sink *s = &sinks[sink_count];
+		save_request_options(&s->options);
+		s->header_printed = 0;
+		s->records_printed = 0;
+		if (sink_open(&s->sink, path) < 0)
+			r = -1;
+		else
+			sink_count++;
+	}
+	restore_request_options(&saved);
+
+	return r;
+}
+
+
+/* Finish all outputs (print trailers), returns -1 if writing any of them failed */
+static int close_sinks(void)
+{
+	struct request_options saved;
+	int r = 0;
+
+	save_request_options(&saved);
+	for (int i = 0; i < sink_count; i++) {
+		select_sink(&sinks[i]);
+		end_output();
+		arrow_free(&sinks[i].arrow);
+		if (sink_close(&sinks[i].sink) < 0) {
+			fprintf(stderr, "jpeginfo: error writing output '%s': %s\n", out_specs[i],
+				strerror(errno));
+			r = -1;
+		}
+	}
+	restore_request_options(&saved);
+	outfile = stdout;
+	arrow_out = &main_arrow;
+	sink_count = 0;
+
+	return r;
+}
+
+
+/* Set up line buffer for decoding, buffer is only reallocated when it grows */
+void setup_line_buffer(size_t width)
+{
+	if (width > line_buffer_width) {
+		free(line_buffer_mem);
+		if (!(line_buffer_mem = malloc(sizeof(JSAMPLE) * width * BUF_LINES)))
+			no_memory();
+		line_buffer_width = width;
+		line_buffer_allocs++;
+	}
+	for (int i = 0; i < BUF_LINES; i++)
+		line_buffer[i] = line_buffer_mem + i * line_buffer_width;
+}
+
+
+char* calculate_hash(const unsigned char *buf, size_t buf_len)
+{
+	struct digest_ctx ctx;
+	char digest_text[DIGEST_MAX_SIZE * 2 + 1];
+
+	digest_init(&ctx, hash_mode);
+	digest_update(&ctx, buf, buf_len);
+	digest_final(&ctx, digest_text, sizeof(digest_text));
+
+	return record_strdup(digest_text);
+}
+
+
+/* Complete reading of streamed input (in --stream mode) */
+void finish_input(void)
+{
+	if (!stream_active)
+		return;
+
+	if (hash_mode != HASH_NONE || info.size == 0)
+		info.size = jpeg_stream_drain(&stream_src);
+	if (hash_mode != HASH_NONE) {
+		char digest_text[DIGEST_MAX_SIZE * 2 + 1];
+		info.digest = record_strdup(digest_final(&digest, digest_text, sizeof(digest_text)));
+	}
+	stream_active = false;
+}
+
+
+/*
+ * Own (stream and push) source managers replace the one allocated by
+ * jpeg_mem_src(), and jpeg_mem_src() refuses to reuse a source it did not
+ * allocate. So libjpeg's memory source is kept aside while own sources are
+ * used, and put back before next image from memory.
+ */
+static struct jpeg_source_mgr *mem_src = NULL;
+
+static void keep_mem_src(void)
+{
+	if (cinfo.src && cinfo.src != &stream_src.pub && cinfo.src != &push_src.pub)
+		mem_src = cinfo.src;
+}
+
+
+static void use_mem_src(const unsigned char *inbuf, size_t len)
+{
+	if (cinfo.src == &stream_src.pub || cinfo.src == &push_src.pub)
+		cinfo.src = mem_src;
+	jpeg_mem_src(&cinfo, inbuf, len);
+}
+
+
+/*
+ * Analyze single JPEG image. Image is either in a memory buffer or,
+ * if inbuf is NULL, read from the stream source (infile).
+ */
+int analyze_image(const unsigned char *inbuf, size_t len)
+{
+	JSAMPARRAY buf = line_buffer;
+
+	last_error[0] = 0;
+	stream_active = (inbuf == NULL);
+	progress_start();
+
+	/* Error handler for (libjpeg) errors in decoding */
+	if (setjmp(jerr.setjmp_buffer)) {
+		info.check = (abort_status ? abort_status : 3);
+		info.error = record_strdup(last_error);
+		if (verbose_mode)
+			fprintf(stderr, "Error decoding JPEG image: %s\n", last_error);
+		jpeg_abort_decompress(&cinfo);
+		budget_release(mem_budget);
+		finish_input();
+		if (hash_mode != HASH_NONE && inbuf && !info.digest)
+			info.digest = calculate_hash(inbuf, len);
+		return info.check;
+	}
+
+	/* Read JPEG file header */
+	global_error_counter=0;
+	setup_marker_saving();
+	if (!inbuf) {
+		keep_mem_src();
+		jpeg_stream_src(&cinfo, &stream_src, infile, stream_buffer, stream_buffer_size,
+				(hash_mode != HASH_NONE ? &digest : NULL));
+	} else {
+		use_mem_src(inbuf, len);
+	}
+	jpeg_read_header(&cinfo, TRUE);
+	parse_jpeg_info(&cinfo, &info);
+
+	/* Skip rest of the work if file cannot match the filter (--where) */
+	if (where_expr && filter_eval(&where_filter, &info, HEADER_FIELDS) == FILTER_FALSE) {
+		record_skipped = true;
+		jpeg_abort_decompress(&cinfo);
+		stream_active = false;
+		return info.check;
+	}
+
+	/* Calculate hash (message-digest) of the input file */
+	if (hash_mode != HASH_NONE && inbuf) {
+		info.digest = calculate_hash(inbuf, len);
+	}
+
+	/* Decode JPEG to check for errors in the file */
+	if (check_mode) {
+		check_decode_limits(inbuf ? len : STREAM_BUFFER_SIZE);
+		cinfo.out_color_space = JCS_GRAYSCALE; /* to speed up the process... */
+		cinfo.scale_denom = 8;
+		cinfo.scale_num = 1;
+		jpeg_start_decompress(&cinfo);
+
+		setup_line_buffer(cinfo.output_width * cinfo.out_color_components);
+		while (cinfo.output_scanline < cinfo.output_height) {
+			jpeg_read_scanlines(&cinfo, buf, BUF_LINES);
+		}
+
+		jpeg_finish_decompress(&cinfo);
+		if (verbose_mode && global_error_counter > 0)
+			fprintf(stderr, "Warnings decoding JPEG image: %s\n", last_error);
+		info.check = (global_error_counter == 0 ? 1 : 2);
+		info.error = record_strdup(last_error);
+		budget_release(mem_budget);
+	}
+	else {
+		/* When not checking integrity, just get the info we have. */
+		jpeg_abort_decompress(&cinfo);
+	}
+	finish_input();
+
+	return info.check;
+}
+
+
+/*
+ * Begin incremental analysis of an image, (partial) image data is then fed
+ * in using analyze_push() as it arrives.
+ */
+void analyze_push_begin(void)
+{
+	last_error[0] = 0;
+	global_error_counter = 0;
+	stream_active = false;
+	progress_start();
+
+	if (hash_mode != HASH_NONE)
+		digest_init(&digest, hash_mode);
+	setup_marker_saving();
+	keep_mem_src();
+	jpeg_push_src(&cinfo, &push_src);
+	push_stage = STAGE_HEADER;
+}
+
+
+/*
+ * Feed more image data to the decoder and run it as far as the data goes.
+ * Once the header has been parsed, image dimensions etc. are available
+ * in info. When eof is set, analysis completes (status check verdict and
+ * hash become available).
+ */
+enum push_status analyze_push(const unsigned char *data, size_t len, bool eof)
+{
+	JSAMPARRAY buf = line_buffer;
+
+	if (hash_mode != HASH_NONE && len > 0)
+		digest_update(&digest, data, len);
+	if (push_stage != STAGE_DONE && jpeg_push_data(&push_src, data, len) < 0)
+		no_memory();
+	if (eof)
+		jpeg_push_eof(&push_src);
+
+	/* Error handler for (libjpeg) errors in decoding */
+	if (setjmp(jerr.setjmp_buffer)) {
+		info.check = (abort_status ? abort_status : 3);
+		info.error = record_strdup(last_error);
+		if (verbose_mode)
+			fprintf(stderr, "Error decoding JPEG image: %s\n", last_error);
+		jpeg_abort_decompress(&cinfo);
+		budget_release(mem_budget);
+		push_stage = STAGE_DONE;
+		goto done;
+	}
+
+	switch (push_stage) {
+	case STAGE_HEADER:
+		if (jpeg_read_header(&cinfo, TRUE) == JPEG_SUSPENDED)
+			break;
+		parse_jpeg_info(&cinfo, &info);
+		if (!check_mode) {
+			jpeg_abort_decompress(&cinfo);
+			push_stage = STAGE_DONE;
+			break;
+		}
+		check_decode_limits(push_src.buffer_size);
+		cinfo.out_color_space = JCS_GRAYSCALE;
+		cinfo.scale_denom = 8;
+		cinfo.scale_num = 1;
+		push_stage = STAGE_START;
+		/* fall through */
+
+	case STAGE_START:
+		if (!jpeg_start_decompress(&cinfo))
+			break;
+		setup_line_buffer(cinfo.output_width * cinfo.out_color_components);
+		push_stage = STAGE_SCAN;
+		/* fall through */
+
+	case STAGE_SCAN:
+		while (cinfo.output_scanline < cinfo.output_height) {
+			if (jpeg_read_scanlines(&cinfo, buf, BUF_LINES) == 0)
+				break;
+		}
+		if (cinfo.output_scanline < cinfo.output_height)
+			break;
+		push_stage = STAGE_FINISH;
+		/* fall through */
+
+	case STAGE_FINISH:
+		if (!jpeg_finish_decompress(&cinfo))
+			break;
+		if (verbose_mode && global_error_counter > 0)
+			fprintf(stderr, "Warnings decoding JPEG image: %s\n", last_error);
+		info.check = (global_error_counter == 0 ? 1 : 2);
+		info.error = record_strdup(last_error);
+		budget_release(mem_budget);
+		push_stage = STAGE_DONE;
+		/* fall through */
+
+	case STAGE_DONE:
+		break;
+	}
+
+ done:
+	if (eof && hash_mode != HASH_NONE && !info.digest) {
+		char digest_text[DIGEST_MAX_SIZE * 2 + 1];
+		info.digest = record_strdup(digest_final(&digest, digest_text, sizeof(digest_text)));
+	}
+
+	if (push_stage == STAGE_DONE)
+		return PUSH_DONE;
+	return (push_stage == STAGE_HEADER ? PUSH_NEED_HEADER : PUSH_HEADER);
+}
+
+
+/* Abandon incremental analysis of current image (if still in progress). */
+void analyze_push_abort(void)
+{
+	if (push_stage == STAGE_DONE)
+		return;
+
+	jpeg_abort_decompress(&cinfo);
+	budget_release(mem_budget);
+	push_stage = STAGE_DONE;
+}
+
+
+/* Read image from an (already opened) input stream and analyze it. */
+int analyze_stream(FILE *fp)
+{
+	static unsigned char *inbuf = NULL;
+	long long file_size = filesize(fp);
+
+	infile = fp;
+
+	/* Without check or hash only the file header needs to be read */
+	bool header_only = (!check_mode && hash_mode == HASH_NONE);
+
+	if (stream_mode || header_only) {
+		/* Input is read (and hashed) as decoder consumes it */
+		if (!stream_buffer && !(stream_buffer = malloc(STREAM_BUFFER_SIZE)))
+			no_memory();
+		stream_buffer_size = (header_only ? HEADER_BUFFER_SIZE : STREAM_BUFFER_SIZE);
+		if (hash_mode != HASH_NONE)
+			digest_init(&digest, hash_mode);
+		info.size = (file_size > 0 ? file_size : 0);
+		return analyze_image(NULL, 0);
+	}
+
+	/* Read input file into a memory buffer */
+	if ((file_size = read_file(fp, (file_size > 0 ? file_size : 256 * 1024), &inbuf)) < 0)
+		no_memory();
+	info.size = file_size;
+
+	return analyze_image(inbuf, file_size);
+}
+
+
+static void flush_output(void)
+{
+	if (sink_count > 0)
+		fflush(NULL);
+	else
+		fflush(outfile);
+}
+
+
+/* Pass complete (streamed) records on at least once a second */
+static void periodic_flush(void)
+{
+	static time_t last_flush = 0;
+
+	if (!ndjson_mode && sink_count == 0)
+		return;
+	time_t now = time(NULL);
+	if (now != last_flush) {
+		flush_output();
+		last_flush = now;
+	}
+}
+
+
+/* Print out results of the image analysis (and delete file if needed) */
+void output_result(void)
+{
+	if (deadline_cut)
+		return;
+	if (where_expr && (record_skipped ||
+				filter_eval(&where_filter, &info, FIELDS_ALL) != FILTER_TRUE))
+		return;
+
+	print_jpeg_info(&info);
+	stats_records++;
+
+	if (sample_rate > 0 && check_mode && current)
+		sampler_result(&sampler, current, info.check);
+
+	if (delete_mode && current && !stdin_mode && !frames_mode && !framed_mode) {
+		if (info.check == 3 || (info.check == 2 && !del_mode))
+			delete_file(current, verbose_mode, quiet_mode);
+	}
+
+	if (flush_mode) {
+		flush_output();
+	} else {
+		periodic_flush();
+	}
+}
+
+
+void process_image(const unsigned char *inbuf, size_t len)
+{
+	analyze_image(inbuf, len);
+	output_result();
+}
+
+
+/* Split input into frames (concatenated JPEG images) and analyze each of them */
+void process_frames(FILE *fp)
+{
+	struct frame_reader reader;
+	const unsigned char *frame;
+	size_t frame_len;
+	long long offset;
+	long frames = 0, warnings = 0, errors = 0;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	frame_reader_init(&reader, fp);
+
+	while (frame_reader_next(&reader, &frame, &frame_len, &offset) > 0) {
+		free_jpeg_info(&info);
+		info.filename = record_strdup(current);
+		info.size = frame_len;
+		info.offset = offset;
+		process_image(frame, frame_len);
+		frames++;
+		if (info.check == 2)
+			warnings++;
+		else if (info.check == 3)
+			errors++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	frame_reader_free(&reader);
+
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (!quiet_mode)
+		fprintf(stderr, "%s: %ld frames (%ld corrupt, %ld with warnings), "
+			"%lld bytes skipped, %0.3fs (%0.1f frames/s)\n",
+			current, frames, errors, warnings, reader.skipped, elapsed,
+			(elapsed > 0 ? frames / elapsed : 0.0));
+}
+
+
+/* Process stream of length-prefixed records (in --framed mode) */
+void process_framed(int fd)
+{
+	struct framed_reader reader;
+	const char *id;
+	const unsigned char *data;
+	size_t id_len, data_len;
+	int r;
+
+	framed_reader_init(&reader, fd, flush_output);
+
+	while ((r = framed_reader_next(&reader, &id, &id_len, &data, &data_len)) > 0) {
+		free_jpeg_info(&info);
+		info.filename = record_strndup(id, id_len);
+		current = info.filename;
+		info.size = data_len;
+		process_image(data, data_len);
+	}
+	if (r < 0 && !quiet_mode)
+		fprintf(stderr, "jpeginfo: invalid or truncated input record\n");
+
+	framed_reader_free(&reader);
+	current = NULL;
+}
+
+
+/* Open and analyze a file, returns -1 if file was not processed. */
+int analyze_file(const char *filename)
+{
+	free_jpeg_info(&info);
+
+	/* Open input file */
+	if (stdin_mode) {
+		if (verbose_mode)
+			fprintf(stderr, "Reading file: <STDIN>\n");
+		infile = stdin;
+		current = "-";
+	} else {
+		if (!filename || *filename == 0)
+			return -1;
+		current = (char*)filename;
+
+		if (verbose_mode)
+			fprintf(stderr, "Reading file: %s\n", current);
+		if ((infile=fopen(current,"rb"))==NULL) {
+			if (!quiet_mode) fprintf(stderr, "jpeginfo: can't open '%s'\n", current);
+			return -1;
+		}
+		if (is_dir(infile)) {
+			fclose(infile);
+			if (verbose_mode) fprintf(stderr, "Skipping directory: %s\n", current);
+			return -1;
+		}
+	}
+
+	if (frames_mode) {
+		process_frames(infile);
+	} else {
+		info.filename = record_strdup(current);
+		analyze_stream(infile);
+	}
+
+	if (infile != stdin)
+		fclose(infile);
+	infile = NULL;
+
+	return 0;
+}
+
+
+void process_file(const char *filename)
+{
+	if (analyze_file(filename) < 0)
+		return;
+
+	if (!frames_mode)
+		output_result();
+}
+
+
+/* Save current progress into checkpoint file */
+static void checkpoint_write(bool complete)
+{
+	struct stat st;
+
+	fflush(outfile);
+	ckpt.errors = global_total_errors;
+	ckpt.records = records_printed;
+	ckpt.header = header_printed;
+	ckpt.complete = complete;
+	ckpt.output_offset = -1;
+	if (fstat(fileno(outfile), &st) == 0 && S_ISREG(st.st_mode)) {
+		/* Make sure output is on disk before checkpoint refers to it */
+		fsync(fileno(outfile));
+		ckpt.output_offset = lseek(fileno(outfile), 0, SEEK_CUR);
+	}
+
+	if (checkpoint_save(checkpoint_file, &ckpt) == 0) {
+		ckpt_last_save = time(NULL);
+		ckpt_unsaved = 0;
+	}
+}
+
+
+/* Note that (next) input file has been processed, save checkpoint periodically */
+void checkpoint_update(void)
+{
+	if (!checkpoint_file)
+		return;
+
+	ckpt.position++;
+	if (++ckpt_unsaved >= CHECKPOINT_INTERVAL_MAX ||
+		time(NULL) - ckpt_last_save >= CHECKPOINT_INTERVAL)
+		checkpoint_write(false);
+}
+
+
+static void pack_int(FILE *out, long long val)
+{
+	fwrite(&val, sizeof(val), 1, out);
+}
+
+
+static void pack_str(FILE *out, const char *str)
+{
+	uint32_t len = (str ? strlen(str) : UINT32_MAX);
+
+	fwrite(&len, sizeof(len), 1, out);
+	if (str)
+		fwrite(str, 1, len, out);
+}
+
+
+static long long unpack_int(const unsigned char **p, const unsigned char *end)
+{
+	long long val = 0;
+
+	if (end - *p >= sizeof(val)) {
+		memcpy(&val, *p, sizeof(val));
+		*p += sizeof(val);
+	}
+
+	return val;
+}
+
+
+static char *unpack_str(const unsigned char **p, const unsigned char *end)
+{
+	uint32_t len;
+	char *str;
+
+	if (end - *p < sizeof(len))
+		return NULL;
+	memcpy(&len, *p, sizeof(len));
+	*p += sizeof(len);
+	if (len == UINT32_MAX || end - *p < len)
+		return NULL;
+
+	str = record_strndup((const char*)*p, len);
+	*p += len;
+
+	return str;
+}
+
+
+/* Analyze file (in a worker process) and return serialized results. */
+static size_t worker_analyze(const char *path, const unsigned char **result)
+{
+	static char *buf = NULL;
+	static size_t buf_size = 0;
+
+	global_total_errors = 0;
+	if (analyze_file(path) < 0)
+		return 0;
+
+	FILE *out = open_memstream(&buf, &buf_size);
+	if (!out)
+		no_memory();
+	pack_int(out, deadline_cut);
+	pack_int(out, info.width);
+	pack_int(out, info.height);
+	pack_int(out, info.color_depth);
+	pack_int(out, info.progressive);
+	pack_int(out, info.check);
+	pack_int(out, info.size);
+	pack_int(out, global_total_errors);
+	pack_str(out, info.type);
+	pack_str(out, info.info);
+	pack_str(out, info.comments);
+	pack_str(out, info.digest);
+	pack_str(out, info.error);
+	fclose(out);
+
+	*result = (unsigned char*)buf;
+	return buf_size;
+}
+
+
+/* Output results (received from a worker process) for a file. */
+static void worker_result(const char *path, const unsigned char *result, size_t len,
+	bool crashed)
+{
+	const unsigned char *p = result, *end = result + len;
+
+	/* Files after one cut off by the deadline are left for the next run too */
+	if (deadline_cut)
+		return;
+	if (!crashed && len == 0) {
+		checkpoint_update();
+		return;
+	}
+	if (!crashed && unpack_int(&p, end)) {
+		deadline_reached = deadline_cut = true;
+		return;
+	}
+
+	free_jpeg_info(&info);
+	info.filename = record_strdup(path);
+	current = (char*)path;
+
+	if (crashed) {
+		info.check = 4;
+		info.error = record_strdup("Worker process crashed");
+		global_total_errors++;
+	} else {
+		info.width = unpack_int(&p, end);
+		info.height = unpack_int(&p, end);
+		info.color_depth = unpack_int(&p, end);
+		info.progressive = unpack_int(&p, end);
+		info.check = unpack_int(&p, end);
+		info.size = unpack_int(&p, end);
+		global_total_errors += unpack_int(&p, end);
+		info.type = unpack_str(&p, end);
+		info.info = unpack_str(&p, end);
+		info.comments = unpack_str(&p, end);
+		info.digest = unpack_str(&p, end);
+		info.error = unpack_str(&p, end);
+	}
+
+	output_result();
+	checkpoint_update();
+}
+
+
+/* Apply single (per request) option, returns -1 if option is not valid. */
+static int set_request_option(const char *key, const char *val, bool *use_fd)
+{
+	if (!strcmp(key, "check"))
+		check_mode = (atoi(val) > 0);
+	else if (!strcmp(key, "comments"))
+		com_mode = (atoi(val) > 0);
+	else if (!strcmp(key, "info"))
+		longinfo_mode = (atoi(val) > 0);
+	else if (!strcmp(key, "fd") && use_fd)
+		*use_fd = (atoi(val) > 0);
+	else if (!strcmp(key, "hash"))
+		return parse_hash_mode(val, &hash_mode);
+	else if (!strcmp(key, "format"))
+		return (set_output_format(val) < 0 || arrow_mode ? -1 : 0);
+	else
+		return -1;
+
+	return 0;
+}
+
+
+/*
+ * Parse request line. Request consists of space separated key=value pairs,
+ * "path" and "name" must be last as their value extends to end of line.
+ */
+static int parse_request(char *line, char **path, char **name, bool *use_fd)
+{
+	char *p = line;
+
+	*path = *name = NULL;
+	*use_fd = false;
+
+	while (p && *p) {
+		while (*p == ' ')
+			p++;
+		if (!*p)
+			break;
+
+		char *key = p;
+		char *val = strchr(p, '=');
+		if (!val)
+			return -1;
+		*val++ = 0;
+
+		if (!strcmp(key, "path") || !strcmp(key, "name")) {
+			*(key[0] == 'p' ? path : name) = val;
+			break;
+		}
+
+		if ((p = strchr(val, ' ')))
+			*p++ = 0;
+
+		if (set_request_option(key, val, use_fd) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/* Serve requests from a single connection (in daemon mode) */
+static void daemon_handler(int fd)
+{
+	static struct conn_reader conn;
+	static struct request_options defaults;
+	static bool defaults_saved = false;
+	char *line, *path, *name;
+	bool use_fd;
+
+	int outfd = dup(fd);
+	FILE *out = (outfd >= 0 ? fdopen(outfd, "w") : NULL);
+	if (!out) {
+		if (outfd >= 0)
+			close(outfd);
+		return;
+	}
+
+	if (!defaults_saved) {
+		save_request_options(&defaults);
+		defaults_saved = true;
+	}
+
+	conn_reader_init(&conn, fd);
 
-	/* Loop to process input file(s) */
-	do {
+	while ((line = conn_read_line(&conn))) {
+		restore_request_options(&defaults);
 		free_jpeg_info(&info);
 
-		/* Open input file */
-		if (stdin_mode) {
-			if (verbose_mode)
-				fprintf(stderr, "Reading file: <STDIN>\n");
-			infile = stdin;
-			inbuffer_size = 256 * 1024;
-			current = "-";
+		if (parse_request(line, &path, &name, &use_fd) < 0) {
+			info.check = 3;
+			info.error = record_strdup("Invalid request");
 		} else {
-			if (input_from_file) {
-				if (!fgetstr(namebuf, sizeof(namebuf), listfile))
-					break;
-				current=namebuf;
+			FILE *fp = NULL;
+
+			if (use_fd) {
+				int rfd = conn_take_fd(&conn);
+				if (rfd >= 0) {
+					lseek(rfd, 0, SEEK_SET);
+					if (!(fp = fdopen(rfd, "rb")))
+						close(rfd);
+				} else {
+					errno = EBADF;
+				}
+			} else if (path) {
+				fp = fopen(path, "rb");
 			} else {
-				if ((current = argv[i]) == NULL)
-					break;
+				errno = ENOENT;
 			}
-			if (*current == 0)
-				continue;
-
-			if (verbose_mode)
-				fprintf(stderr, "Reading file: %s\n", current);
-			if ((infile=fopen(current,"rb"))==NULL) {
-				if (!quiet_mode) fprintf(stderr, "jpeginfo: can't open '%s'\n", current);
-				continue;
-			}
-			if (is_dir(infile)) {
-				fclose(infile);
-				if (verbose_mode) fprintf(stderr, "Skipping directory: %s\n", current);
-				continue;
+
+			if (!fp) {
+				char tmp[256];
+				snprintf(tmp, sizeof(tmp), "Cannot open file: %s", strerror(errno));
+				info.check = 3;
+				info.error = record_strdup(tmp);
+			} else if (is_dir(fp)) {
+				info.check = 3;
+				info.error = record_strdup("Is a directory");
+			} else {
+				analyze_stream(fp);
 			}
-			inbuffer_size = filesize(infile);
+			if (fp)
+				fclose(fp);
+			infile = NULL;
 		}
-		info.filename = strdup(current);
+		if (!info.filename)
+			info.filename = record_strdup(name ? name : (path ? path : ""));
 
-		/* Read input file into a memory buffer */
-		if ((file_size = read_file(infile, inbuffer_size, &inbuf)) < 0)
-			no_memory();
-		fclose(infile);
-		info.size = file_size;
-		last_error[0] = 0;
+		print_jpeg_record(out, &info);
+		if (json_mode && !ndjson_mode)
+			fputc('\n', out);
+		if (fflush(out) == EOF)
+			break;
+	}
 
-		/* Error handler for (libjpeg) errors in decoding */
-		if (setjmp(jerr.setjmp_buffer)) {
-			info.check = 3;
-			info.error = strdup(last_error);
-			if (verbose_mode)
-				fprintf(stderr, "Error decoding JPEG image: %s\n", last_error);
-			jpeg_abort_decompress(&cinfo);
-			clear_line_buffer(buf);
-			if (quiet_mode < 2)
-				print_jpeg_info(&info);
-			if (stdin_mode)
+	conn_reader_close(&conn);
+	fclose(out);
+}
+
+
+/* Parse JSON string value (pointed by *pp) into string allocated for the record */
+static char *json_string(const char **pp)
+{
+	const char *p = *pp;
+
+	if (*p++ != '"')
+		return NULL;
+
+	/* Find end of the string, to allocate just enough space for it */
+	const char *q = p;
+	while (*q && *q != '"')
+		q += (*q == '\\' && *(q + 1) ? 2 : 1);
+	char *str = record_alloc(q - p + 1);
+
+	char *o = str;
+	while (*p && *p != '"') {
+		if (*p == '\\' && *(p + 1)) {
+			p++;
+			switch (*p) {
+			case 'n':
+				*o++ = '\n';
+				break;
+			case 't':
+				*o++ = '\t';
+				break;
+			case 'r':
+				*o++ = '\r';
+				break;
+			case 'u':
+				if (isxdigit(p[1]) && isxdigit(p[2]) && isxdigit(p[3]) && isxdigit(p[4])) {
+					char hex[5] = { p[1], p[2], p[3], p[4], 0 };
+					*o++ = (char)strtol(hex, NULL, 16);
+					p += 4;
+				}
 				break;
-			if (delete_mode)
-				delete_file(current, verbose_mode, quiet_mode);
+			default:
+				*o++ = *p;
+			}
+			p++;
 			continue;
 		}
+		*o++ = *p++;
+	}
+	*o = 0;
+	*pp = (*p == '"' ? p + 1 : p);
+
+	return str;
+}
+
+
+/* Parse (flat) JSON object returned by the daemon into jpeg_info */
+int parse_json_record(const char *line, struct jpeg_info *info)
+{
+	const char *p = strchr(line, '{');
+
+	if (!p)
+		return -1;
+	p++;
+
+	while (*p) {
+		while (*p == ' ' || *p == ',')
+			p++;
+		if (*p != '"')
+			break;
+
+		char *key = json_string(&p);
+		while (*p == ' ' || *p == ':')
+			p++;
+
+		if (*p == '"') {
+			char *val = json_string(&p);
+
+			if (!strcmp(key, "filename"))
+				info->filename = val;
+			else if (!strcmp(key, "hash") && *val)
+				info->digest = val;
+			else if (!strcmp(key, "type"))
+				info->type = val;
+			else if (!strcmp(key, "info"))
+				info->info = val;
+			else if (!strcmp(key, "comments"))
+				info->comments = val;
+			else if (!strcmp(key, "status_detail") && (*val || info->check > 0))
+				info->error = val;
+			else {
+				if (!strcmp(key, "color_depth"))
+					info->color_depth = atoi(val);
+				else if (!strcmp(key, "mode"))
+					info->progressive = !strcmp(val, "Progressive");
+				else if (!strcmp(key, "status"))
+					info->check = (!strcmp(val, "OK") ? 1 :
+						(!strcmp(val, "WARNING") ? 2 :
+							(!strcmp(val, "ERROR") ? 3 :
+								(!strcmp(val, "CRASH") ? 4 :
+									(!strcmp(val, "TIMEOUT") ? 5 :
+										(!strcmp(val, "LIMIT") ? 6 : 0))))));
+			}
+		} else {
+			char *end;
+			long long val = strtoll(p, &end, 10);
+
+			if (end == p)
+				return -1;
+			p = end;
+			if (!strcmp(key, "size"))
+				info->size = val;
+			else if (!strcmp(key, "width"))
+				info->width = val;
+			else if (!strcmp(key, "height"))
+				info->height = val;
+			else if (!strcmp(key, "offset"))
+				info->offset = val;
+		}
+	}
 
-		/* Calculate hash (message-digest) of the input file */
-		if (hash_mode != HASH_NONE) {
-			info.digest = calculate_hash(inbuf, file_size);
+	return 0;
+}
+
+
+/* Process file using a daemon (in client mode) */
+void client_process_file(const char *filename)
+{
+	static struct conn_reader conn;
+	static int sock = -1;
+	char request[MAXPATHLEN + 256];
+	int fd;
+
+	if (sock < 0) {
+		if ((sock = client_connect_unix(client_socket)) < 0) {
+			fprintf(stderr, "jpeginfo: cannot connect to '%s': %s\n",
+				client_socket, strerror(errno));
+			exit(2);
 		}
+		conn_reader_init(&conn, sock);
+		signal(SIGPIPE, SIG_IGN);
+	}
+
+	free_jpeg_info(&info);
 
-		/* Read JPEG file header */
-		global_error_counter=0;
-		jpeg_save_markers(&cinfo, JPEG_COM, 0xffff);
-		for (int j = 0; j < 16; j++) {
-			jpeg_save_markers(&cinfo, JPEG_APP0 + j, 0xffff);
+	if (stdin_mode) {
+		fd = fileno(stdin);
+		current = "-";
+	} else {
+		if (!filename || *filename == 0)
+			return;
+		current = (char*)filename;
+		if (strchr(current, '\n')) {
+			if (!quiet_mode) fprintf(stderr, "jpeginfo: invalid filename '%s'\n", current);
+			return;
 		}
-		jpeg_mem_src(&cinfo, inbuf, file_size);
-		jpeg_read_header(&cinfo, TRUE);
-		parse_jpeg_info(&cinfo, &info);
+		if (verbose_mode)
+			fprintf(stderr, "Reading file: %s\n", current);
+		if ((fd = open(current, O_RDONLY)) < 0) {
+			if (!quiet_mode) fprintf(stderr, "jpeginfo: can't open '%s'\n", current);
+			return;
+		}
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+			close(fd);
+			if (verbose_mode) fprintf(stderr, "Skipping directory: %s\n", current);
+			return;
+		}
+	}
+
+	snprintf(request, sizeof(request),
+		"check=%d hash=%s comments=1 info=1 format=json fd=1 name=%s\n",
+		(check_mode ? 1 : 0), hash_mode_name(hash_mode), current);
+
+	int r = send_with_fd(sock, request, strlen(request), fd);
+	if (!stdin_mode)
+		close(fd);
+
+	char *line = (r < 0 ? NULL : conn_read_line(&conn));
+	if (!line || parse_json_record(line, &info) < 0) {
+		fprintf(stderr, "jpeginfo: no response from daemon\n");
+		exit(2);
+	}
+	if (info.check > 1)
+		global_total_errors++;
+
+	output_result();
+}
+
+
+/* Run in daemon mode */
+int run_daemon(void)
+{
+	int fd = server_listen_unix(daemon_socket);
+
+	if (fd < 0)
+		return -1;
+
+	if (!csv_mode && !list_mode && !json_mode && !format_mode)
+		set_output_format("json");
+	if (worker_count < 1)
+		worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (verbose_mode)
+		fprintf(stderr, "jpeginfo: listening on '%s' (%d workers)\n",
+			daemon_socket, worker_count);
+
+	server_run(fd, worker_count, daemon_handler, &stop_requested);
+	close(fd);
+	unlink(daemon_socket);
+
+	return 0;
+}
+
+
+static const char *output_content_type(void)
+{
+	if (ndjson_mode)
+		return "application/x-ndjson";
+	if (json_mode)
+		return "application/json";
+	if (csv_mode)
+		return "text/csv";
+	return "text/plain";
+}
+
+
+/* Send output record for the image as HTTP response */
+static int http_send_record(int fd, int status, int keep_alive)
+{
+	format_jpeg_record(&record_out, &info);
+	if (!ndjson_mode)
+		outbuf_putc(&record_out, '\n');
+	int r = http_send_response(fd, status, output_content_type(), record_out.buf,
+				record_out.len, keep_alive);
+	record_out.len = 0;
+
+	return r;
+}
+
+
+/*
+ * Handle POST /check request. Image is analyzed as the body arrives, so that
+ * oversized images can be rejected (max_pixels) before upload completes.
+ * Returns -1 if connection should be closed.
+ */
+static int http_check_request(struct http_conn *conn, struct http_request *req)
+{
+	char *query = req->query;
+	char *key, *val, *name = NULL;
+	long long request_max_pixels = 0;
+	const unsigned char *data;
+	size_t len;
+	int r;
+
+	free_jpeg_info(&info);
+
+	while ((key = http_next_param(&query, &val))) {
+		if (!strcmp(key, "name"))
+			name = val;
+		else if (!strcmp(key, "max_pixels"))
+			request_max_pixels = atoll(val);
+		else if (set_request_option(key, val, NULL) < 0) {
+			if (http_discard_body(conn, req) < 0)
+				return -1;
+			return http_send_response(conn->fd, 400, NULL, NULL, 0, req->keep_alive);
+		}
+	}
+
+	info.filename = record_strdup(name ? name : "-");
+	info.size = req->content_length;
+	analyze_push_begin();
+
+	while ((r = http_read_body(conn, req, &data, &len)) > 0) {
+		if (analyze_push(data, len, false) == PUSH_NEED_HEADER || request_max_pixels < 1)
+			continue;
+		if ((long long)info.width * info.height > request_max_pixels) {
+			analyze_push_abort();
+			info.check = 3;
+			info.error = record_strdup("Image too large");
+			http_send_record(conn->fd, 413, 0);
+			http_lingering_close(conn->fd);
+			return -1;
+		}
+		request_max_pixels = 0;
+	}
+	if (r < 0) {
+		analyze_push_abort();
+		return -1;
+	}
+	analyze_push(NULL, 0, true);
+
+	return http_send_record(conn->fd, 200, req->keep_alive);
+}
+
+
+/* Serve HTTP requests from a single connection (in HTTP server mode) */
+static void http_handler(int fd)
+{
+	static struct http_conn conn;
+	static struct request_options defaults;
+	static bool defaults_saved = false;
+	struct http_request req;
+	int r;
+
+	if (!defaults_saved) {
+		save_request_options(&defaults);
+		defaults_saved = true;
+	}
+
+	server_tune_connection(fd, HTTP_IDLE_TIMEOUT);
+	http_conn_init(&conn, fd);
+
+	while (http_read_request(&conn, &req) > 0) {
+		if (strcmp(req.path, "/check")) {
+			r = http_discard_body(&conn, &req);
+			if (r >= 0)
+				r = http_send_response(fd, 404, NULL, NULL, 0, req.keep_alive);
+		} else if (strcmp(req.method, "POST")) {
+			r = http_discard_body(&conn, &req);
+			if (r >= 0)
+				r = http_send_response(fd, 405, NULL, NULL, 0, req.keep_alive);
+		} else {
+			restore_request_options(&defaults);
+			r = http_check_request(&conn, &req);
+		}
+		if (r < 0 || !req.keep_alive)
+			break;
+	}
+}
+
+
+/* Run in HTTP server mode */
+int run_http_server(void)
+{
+	int fd = server_listen_tcp(http_address, http_public);
+
+	if (fd < 0)
+		return -1;
+
+	if (!csv_mode && !list_mode && !json_mode && !format_mode)
+		set_output_format("json");
+	if (worker_count < 1)
+		worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (verbose_mode)
+		fprintf(stderr, "jpeginfo: listening on '%s' (%d workers)\n",
+			http_address, worker_count);
+
+	server_run(fd, worker_count, http_handler, &stop_requested);
+	close(fd);
+
+	return 0;
+}
+
+
+static const char *read_input_name(void)
+{
+	const char *name;
+
+	if (!input_from_file)
+		return (arg_values && *arg_values ? *arg_values++ : NULL);
+
+	/* Read list(s) of files, one source after another */
+	while (!(name = filelist_next(&input_list))) {
+		filelist_close(&input_list);
+		if (list_source_index >= list_source_count)
+			return NULL;
+
+		const char *source = list_sources[list_source_index++];
+		if (verbose_mode)
+			fprintf(stderr, "Reading input filenames from: '%s'\n", source);
+		if (filelist_open(&input_list, source, (null_mode ? 0 : '\n')) < 0) {
+			fprintf(stderr, "Cannot open file '%s'.\n", source);
+			exit(2);
+		}
+		input_list.idle = flush_output;
+	}
+
+	return name;
+}
+
+
+/* Return next input file, skipping files outside size limits (--min-size, --max-size) */
+static const char *read_input_file(void)
+{
+	const char *name;
+	struct stat st;
+
+	while ((name = read_input_name())) {
+		if ((min_size < 0 && max_size < 0) || !strcmp(name, "-") || stat(name, &st) < 0
+			|| !S_ISREG(st.st_mode))
+			return name;
+		if ((min_size < 0 || st.st_size >= min_size) && (max_size < 0 || st.st_size <= max_size))
+			return name;
+	}
+
+	return NULL;
+}
+
+
+static const char *next_shard_file(void)
+{
+	static const char **list = NULL;
+	static size_t list_len = 0, list_pos = 0;
+	const char *name;
 
+	if (shard_count < 2)
+		return read_input_file();
 
-		/* Decode JPEG to check for errors in the file */
-		if (check_mode) {
-			cinfo.out_color_space = JCS_GRAYSCALE; /* to speed up the process... */
-			cinfo.scale_denom = 8;
-			cinfo.scale_num = 1;
-			jpeg_start_decompress(&cinfo);
+	if (!shard_by_size) {
+		while ((name = read_input_file())) {
+			if (shard_match(name, shard_index, shard_count))
+				return name;
+		}
+		return NULL;
+	}
 
-			for (int j = 0; j < BUF_LINES; j++) {
-				buf[j] = malloc(sizeof(JSAMPLE) * cinfo.output_width *
-						cinfo.out_color_components);
-				if (!buf[j])
+	/* Balancing by size needs the whole list up front */
+	if (!list) {
+		size_t list_size = 1024;
+		if (!(list = malloc(sizeof(char*) * list_size)))
+			no_memory();
+		while ((name = read_input_file())) {
+			if (list_len >= list_size) {
+				list_size *= 2;
+				if (!(list = realloc(list, sizeof(char*) * list_size)))
 					no_memory();
 			}
-			while (cinfo.output_scanline < cinfo.output_height) {
-				jpeg_read_scanlines(&cinfo, buf, BUF_LINES);
-			}
-			clear_line_buffer(buf);
+			if (!(list[list_len++] = strdup(name)))
+				no_memory();
+		}
+		size_t selected = shard_balance(list, list_len, shard_index, shard_count);
+		if (verbose_mode)
+			fprintf(stderr, "jpeginfo: shard %d/%d: %lu of %lu files\n",
+				shard_index + 1, shard_count, (unsigned long)selected,
+				(unsigned long)list_len);
+		while (list_len > selected)
+			free((char*)list[--list_len]);
+	}
+
+	if (list_pos > 0)
+		free((char*)list[list_pos - 1]);
+	if (list_pos < list_len)
+		return list[list_pos++];
+
+	/* End of input */
+	free(list);
+	list = NULL;
+	list_len = list_pos = 0;
+	return NULL;
+}
+
+
+static const char *next_sample_file(void)
+{
+	const char *name;
+
+	if (sample_rate <= 0)
+		return next_shard_file();
+
+	while ((name = next_shard_file())) {
+		if (sampler_select(&sampler, name))
+			return name;
+	}
+
+	return NULL;
+}
+
+
+/* Return name of the next file to process, or NULL if there are no more */
+const char *next_input_file(void)
+{
+	const char *name;
+
+	if (active_queue)
+		queue_touch(active_queue);
+	if (run_deadline > 0 && !deadline_reached && now_ns() >= run_deadline) {
+		if (!quiet_mode)
+			fprintf(stderr, "jpeginfo: deadline reached, not processing more files\n");
+		deadline_reached = true;
+	}
+	if (deadline_reached)
+		return NULL;
+	if (tier_check)
+		return read_input_name();
+
+	/* Skip files already processed (when resuming from a checkpoint) */
+	while ((name = next_sample_file()) && checkpoint_skip > 0)
+		checkpoint_skip--;
+
+	return name;
+}
+
+
+/* Restore state from checkpoint file (if it exists) */
+int checkpoint_resume(void)
+{
+	struct stat st;
+	int r = checkpoint_load(checkpoint_file, &ckpt);
+
+	if (r == 0) {
+		/* New run, save initial state (output offset) right away */
+		checkpoint_write(false);
+		return r;
+	}
+	if (r < 0)
+		return r;
+	ckpt_last_save = time(NULL);
+
+	checkpoint_skip = ckpt.position;
+	global_total_errors = ckpt.errors;
+	records_printed = ckpt.records;
+	header_printed = ckpt.header;
+
+	/* Discard output written after the checkpoint was saved */
+	int fd = fileno(outfile);
+	if (ckpt.output_offset >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		if (st.st_size < ckpt.output_offset)
+			fprintf(stderr, "jpeginfo: output file is shorter than in checkpoint "
+				"(was it truncated?)\n");
+		else if (ftruncate(fd, ckpt.output_offset) < 0 ||
+			lseek(fd, ckpt.output_offset, SEEK_SET) < 0)
+			fprintf(stderr, "jpeginfo: cannot truncate output: %s\n",
+				strerror(errno));
+	}
+	if (verbose_mode)
+		fprintf(stderr, "jpeginfo: resuming from checkpoint (%lld files processed)\n",
+			ckpt.position);
+
+	return r;
+}
+
+
+/* Process all input files (given as arguments or read from a list) */
+void process_inputs(void)
+{
+	if (worker_count > 0 && !client_socket && !frames_mode) {
+		/* Process files using crash isolated worker processes */
+		if (pool_run(worker_count, worker_mem, next_input_file, worker_analyze,
+				worker_result, &stop_requested) < 0)
+			exit(2);
+		return;
+	}
+
+	/* Loop to process input file(s) */
+	while (!stop_requested && (current = (char*)next_input_file())) {
+		if (client_socket)
+			client_process_file(current);
+		else
+			process_file(current);
+		if (!deadline_cut)
+			checkpoint_update();
+	}
+}
+
+
+/*
+ * Process input files in two tiers: first output records with information
+ * from the file headers only (reading just the beginning of each file) for
+ * all files, then check the files (fully decode them) and output the
+ * records again, now with the check results.
+ */
+int process_tiered(void)
+{
+	char spool_name[MAXPATHLEN + 1];
+	const char *tmpdir = getenv("TMPDIR");
+	long files = 0;
+
+	snprintf(spool_name, sizeof(spool_name), "%s/jpeginfo-tiered.XXXXXX",
+		(tmpdir && *tmpdir ? tmpdir : "/tmp"));
+	int fd = mkstemp(spool_name);
+	FILE *spool = (fd >= 0 ? fdopen(fd, "w") : NULL);
+	if (!spool) {
+		fprintf(stderr, "jpeginfo: cannot create temporary file: %s\n", strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	/* Tier 1: header information, files are listed for the second tier */
+	bool save_check = check_mode, save_delete = delete_mode;
+	int save_stream = stream_mode;
+	enum hash_modes save_hash = hash_mode;
 
-			jpeg_finish_decompress(&cinfo);
-			if (verbose_mode && global_error_counter > 0)
-				fprintf(stderr, "Warnings decoding JPEG image: %s\n", last_error);
-			info.check = (global_error_counter == 0 ? 1 : 2);
-			info.error = strdup(last_error);
-			print_jpeg_info(&info);
-			if (delete_mode && !del_mode && info.check > 1)
-					delete_file(current, verbose_mode, quiet_mode);
+	check_mode = delete_mode = false;
+	stream_mode = 1;
+	hash_mode = HASH_NONE;
+	flush_mode = true;
+
+	while (!stop_requested && (current = (char*)next_input_file())) {
+		if (analyze_file(current) < 0)
+			continue;
+		output_result();
+		if (fwrite(current, strlen(current) + 1, 1, spool) != 1) {
+			fprintf(stderr, "jpeginfo: cannot write temporary file: %s\n",
+				strerror(errno));
+			fclose(spool);
+			unlink(spool_name);
+			return -1;
 		}
-		else {
-			/* When not checking integrity, just print out info we have. */
-			jpeg_abort_decompress(&cinfo);
-			print_jpeg_info(&info);
+		files++;
+	}
+
+	check_mode = true;
+	delete_mode = save_delete;
+	stream_mode = save_stream;
+	hash_mode = save_hash;
+	if (verbose_mode)
+		fprintf(stderr, "jpeginfo: listed %ld files, checking%s\n", files,
+			(save_check ? "" : " (implied by --tiered)"));
+
+	/* Tier 2: check the listed files */
+	int r = fclose(spool);
+	if (r == 0 && !stop_requested)
+		r = filelist_open(&input_list, spool_name, 0);
+	unlink(spool_name);
+	if (r < 0) {
+		fprintf(stderr, "jpeginfo: cannot read temporary file: %s\n", strerror(errno));
+		return -1;
+	}
+	if (stop_requested)
+		return 0;
+
+	input_from_file = true;
+	list_source_index = list_source_count;
+	tier_check = true;
+	process_inputs();
+	tier_check = false;
+	filelist_close(&input_list);
+
+	return 0;
+}
+
+
+/* Add input files into work queue (in batches) */
+static int queue_add_files(struct work_queue *q)
+{
+	const char **batch = malloc(sizeof(char*) * batch_size);
+	const char *name;
+	size_t n = 0;
+	int ret = 0;
+
+	if (!batch)
+		no_memory();
+
+	do {
+		name = next_input_file();
+		if (name && !(batch[n++] = strdup(name)))
+			no_memory();
+		if ((!name || n >= batch_size) && n > 0) {
+			if (queue_add_batch(q, batch, n) < 0)
+				ret = -1;
+			while (n > 0)
+				free((char*)batch[--n]);
 		}
+	} while (name && ret == 0);
+	free(batch);
+
+	return ret;
+}
 
-	} while ((!stdin_mode && ++i<argc) || input_from_file);
 
-	if (json_mode)
-		printf("\n]\n");
+/* Process batches from a (shared) work queue until it is finished */
+int run_queue(void)
+{
+	static struct work_queue q;
+	const char *ext = (ndjson_mode ? ".ndjson" :
+			(json_mode ? ".json" : (csv_mode ? ".csv" : ".txt")));
+	int r;
+
+	if (queue_init(&q, queue_dir, queue_lease) < 0)
+		return -1;
+	if (queue_add_mode)
+		return queue_add_files(&q);
+	list_source_index = list_source_count;
+
+	while ((r = queue_claim(&q, &stop_requested)) > 0) {
+		const char *result_file = queue_result_file(&q, ext, 1);
+		FILE *out = fopen(result_file, "w");
+		if (!out) {
+			fprintf(stderr, "jpeginfo: cannot create '%s': %s\n", result_file,
+				strerror(errno));
+			return -1;
+		}
+		if (filelist_open(&input_list, queue_batch_file(&q), 0) < 0) {
+			fprintf(stderr, "jpeginfo: cannot open batch '%s': %s\n", q.batch,
+				strerror(errno));
+			fclose(out);
+			continue;
+		}
+		if (verbose_mode)
+			fprintf(stderr, "jpeginfo: processing batch '%s'\n", q.batch);
+
+		input_from_file = true;
+		active_queue = &q;
+		begin_output(out);
+		process_inputs();
+		end_output();
+		begin_output(stdout);
+		active_queue = NULL;
+		filelist_close(&input_list);
+
+		if (stop_requested || deadline_reached) {
+			/* Leave unfinished batch for others (or next run) */
+			fclose(out);
+			queue_release(&q, ext);
+			break;
+		}
+
+		if (fclose(out) == EOF) {
+			fprintf(stderr, "jpeginfo: error writing results: %s\n", strerror(errno));
+			return -1;
+		}
+		if (queue_complete(&q, ext) < 0)
+			return -1;
+	}
+
+	return r;
+}
+
+
+static void stop_signal_handler(int sig)
+{
+	stop_requested = 1;
+}
+
+
+/*****************************************************************************/
+int main(int argc, char **argv)
+{
+	/* Initialize memory structures... */
+	outfile = stdout;
+	outbuf_stream(stdout);
+	clear_jpeg_info(&info);
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jpeg_create_decompress(&cinfo);
+	jerr.pub.error_exit=my_error_exit;
+	jerr.pub.output_message=my_output_message;
+
+	/* Parse command line parameters */
+	parse_args(argc, argv);
+	if (out_count > 0 && open_sinks() < 0)
+		exit(1);
+	arg_values = argv + (optind > 0 ? optind : 1);
+	jpeg_arena_mgr((j_common_ptr)&cinfo, huge_pages_mode);
+	if (deadline > 0)
+		run_deadline = now_ns() + (long long)(deadline * 1e9);
+	if (max_memory > 0) {
+		/* Budget is shared by all worker processes (forked later) */
+		if (!(mem_budget = budget_create(max_memory)))
+			exit(2);
+		cinfo.mem->max_memory_to_use = max_memory;
+	}
+
+	if (daemon_socket || http_address || watch_dir || checkpoint_file) {
+		struct sigaction sa;
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = stop_signal_handler;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+	}
+
+	if (daemon_socket) {
+		if (run_daemon() < 0)
+			exit(2);
+		exit(0);
+	}
+	else if (http_address) {
+		if (run_http_server() < 0)
+			exit(2);
+		exit(0);
+	}
+	else if (watch_dir) {
+		/* Stay resident and process files as they appear in the directory */
+		flush_mode = true;
+		if (watch_directory(watch_dir, watch_delay, process_file, &stop_requested) < 0)
+			exit(2);
+	}
+	else if (framed_mode) {
+		process_framed(fileno(stdin));
+	}
+	else if (stdin_mode) {
+		current = "-";
+		if (client_socket)
+			client_process_file(current);
+		else
+			process_file(current);
+	}
+	else if (queue_dir) {
+		if (run_queue() < 0)
+			exit(2);
+		exit(global_total_errors > 0 ? 1 : 0);
+	}
+	else {
+		if (checkpoint_file && checkpoint_resume() < 0)
+			exit(2);
+		if (tiered_mode) {
+			if (process_tiered() < 0)
+				exit(2);
+		} else {
+			process_inputs();
+		}
+		if (checkpoint_file) {
+			/* Save final state before the output trailer (so that resuming
+			   a finished run outputs the trailer again) */
+			checkpoint_write(!stop_requested && !deadline_reached);
+			if (stop_requested || deadline_reached)
+				exit(global_total_errors > 0 ? 1 : 0);
+		}
+		if (sample_rate > 0 && !quiet_mode)
+			sampler_report(&sampler, stderr, verbose_mode);
+	}
+
+	if (sink_count > 0) {
+		if (close_sinks() < 0)
+			exit(2);
+	} else {
+		end_output();
+	}
+
+	if (stats_mode) {
+		long allocs = record_arena.system_allocs + line_buffer_allocs +
+			jpeg_arena_allocs((j_common_ptr)&cinfo);
+		fprintf(stderr, "jpeginfo: stats: %ld records, heap allocations: %ld record, "
+			"%ld decoder, %ld line buffer (%.3f per record)\n", stats_records,
+			record_arena.system_allocs, jpeg_arena_allocs((j_common_ptr)&cinfo),
+			line_buffer_allocs, (stats_records > 0 ? (double)allocs / stats_records : 0.0));
+	}
 
 	/* Free up allocated memory to keep MemorySanitizier happy :-) */
 	jpeg_destroy_decompress(&cinfo);
 	free_jpeg_info(&info);
-	if (inbuf)
-		free(inbuf);
+	free(line_buffer_mem);
+	arena_free(&record_arena);
+	sampler_free(&sampler);
 
 	 /* Return 1 if any errors found in files checked */
 	return (global_total_errors > 0 ? 1 : 0);
@@ -6,6 +6,7 @@
  */
 
 #include <stdio.h>
+#include <signal.h>
 
 #ifndef MAXPATHLEN
 #define MAXPATHLEN 1024
@@ -28,4 +29,32 @@ long long read_file(FILE *fp, size_t start_size, unsigned char **bufptr);
 char *strncopy(char *dst, const char *src, size_t size);
 char *strncatenate(char *dst, const char *src, size_t size);
 char *str_add_list(char *dst, size_t size, const char *src, const char *delim);
-char *escape_str(const char *src, char escape_char, char escape);
+int parse_size(const char *s, long long *size);
+
+
+/* jpeginfo.c */
+
+struct jpeg_info {
+	int width;
+	int height;
+	int color_depth;
+	int progressive;
+	int check;
+	size_t size;
+	long long offset;
+	char *filename;
+	char *type;
+	char *info;
+	char *comments;
+	char *digest;
+	char *error;
+};
+
+void no_memory(void);
+const char *check_status_str(int check);
+
+
+/* watch.c */
+
+int watch_directory(const char *dir, int delay, void (*callback)(const char *),
+		volatile sig_atomic_t *stop);
@@ -0,0 +1,188 @@
+/* jpegpush.c - suspending (push) source manager for libjpeg
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+#include <jerror.h>
+
+#include "jpegpush.h"
+
+
+/*
+ * Source manager for input that arrives incrementally. Data is pushed in
+ * using jpeg_push_data() as it becomes available, and when the decoder runs
+ * out of input it suspends (libjpeg functions return JPEG_SUSPENDED or
+ * FALSE), so decoding can be resumed once more data has been pushed.
+ *
+ * Only unconsumed data is kept in the buffer, so memory use depends on
+ * the size of the pushed chunks rather than the size of the image.
+ */
+
+#define PUSH_MIN_BUFFER_SIZE (64 * 1024)
+
+
+static void init_source(j_decompress_ptr cinfo)
+{
+	/* nothing to do */
+}
+
+
+static boolean fill_input_buffer(j_decompress_ptr cinfo)
+{
+	struct jpeg_push_source *src = (struct jpeg_push_source*)cinfo->src;
+	static const JOCTET fake_eoi[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
+
+	if (!src->eof)
+		return FALSE; /* suspend until more data is pushed */
+
+	/* Insert a fake EOI marker (same as libjpeg own source managers) */
+	WARNMS(cinfo, JWRN_JPEG_EOF);
+	src->pub.next_input_byte = fake_eoi;
+	src->pub.bytes_in_buffer = 2;
+
+	return TRUE;
+}
+
+
+static void skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+	struct jpeg_push_source *src = (struct jpeg_push_source*)cinfo->src;
+
+	if (num_bytes <= 0)
+		return;
+
+	if (num_bytes > (long)src->pub.bytes_in_buffer) {
+		/* Skip rest when (if) it gets pushed */
+		src->skip += num_bytes - src->pub.bytes_in_buffer;
+		src->pub.next_input_byte += src->pub.bytes_in_buffer;
+		src->pub.bytes_in_buffer = 0;
+		return;
+	}
+	src->pub.next_input_byte += num_bytes;
+	src->pub.bytes_in_buffer -= num_bytes;
+}
+
+
+static void term_source(j_decompress_ptr cinfo)
+{
+	/* nothing to do */
+}
+
+
+/*
+ * Set up push source for decompression. Buffer (if any) allocated for
+ * previous image is reused.
+ */
+void jpeg_push_src(j_decompress_ptr cinfo, struct jpeg_push_source *src)
+{
+	if (!cinfo || !src)
+		return;
+
+	src->pub.init_source = init_source;
+	src->pub.fill_input_buffer = fill_input_buffer;
+	src->pub.skip_input_data = skip_input_data;
+	src->pub.resync_to_restart = jpeg_resync_to_restart;
+	src->pub.term_source = term_source;
+	src->pub.bytes_in_buffer = 0;
+	src->pub.next_input_byte = src->buffer;
+	src->skip = 0;
+	src->bytes_pushed = 0;
+	src->eof = FALSE;
+
+	cinfo->src = &src->pub;
+}
+
+
+/* Append data after the (still unconsumed) input. */
+int jpeg_push_data(struct jpeg_push_source *src, const JOCTET *data, size_t len)
+{
+	if (!src || (!data && len > 0))
+		return -1;
+
+	src->bytes_pushed += len;
+
+	if (src->skip > 0) {
+		size_t skip = (src->skip < len ? src->skip : len);
+		src->skip -= skip;
+		data += skip;
+		len -= skip;
+	}
+	if (len == 0)
+		return 0;
+
+	size_t avail = src->pub.bytes_in_buffer;
+	size_t need = avail + len;
+
+	if (need > src->buffer_size) {
+		size_t new_size = (src->buffer_size > 0 ? src->buffer_size : PUSH_MIN_BUFFER_SIZE);
+		while (new_size < need)
+			new_size *= 2;
+		JOCTET *buf = malloc(new_size);
+		if (!buf)
+			return -1;
+		if (avail > 0)
+			memcpy(buf, src->pub.next_input_byte, avail);
+		free(src->buffer);
+		src->buffer = buf;
+		src->buffer_size = new_size;
+	} else if (avail > 0 && src->pub.next_input_byte != src->buffer) {
+		memmove(src->buffer, src->pub.next_input_byte, avail);
+	}
+
+	memcpy(src->buffer + avail, data, len);
+	src->pub.next_input_byte = src->buffer;
+	src->pub.bytes_in_buffer = need;
+
+	return 0;
+}
+
+
+/* Signal end of input, decoder will not suspend after this. */
+void jpeg_push_eof(struct jpeg_push_source *src)
+{
+	if (src)
+		src->eof = TRUE;
+}
+
+
+void jpeg_push_free(struct jpeg_push_source *src)
+{
+	if (!src)
+		return;
+
+	free(src->buffer);
+	src->buffer = NULL;
+	src->buffer_size = 0;
+	src->pub.next_input_byte = NULL;
+	src->pub.bytes_in_buffer = 0;
+}
+
+/* eof :-) */
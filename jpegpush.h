@@ -0,0 +1,32 @@
+/* jpegpush.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef JPEGPUSH_H
+#define JPEGPUSH_H 1
+
+/* Progress of incremental (push) analysis */
+enum push_status {
+	PUSH_NEED_HEADER = 0,  /* image header not yet available */
+	PUSH_HEADER = 1,       /* image header has been parsed */
+	PUSH_DONE = 2,         /* image has been fully analyzed */
+};
+
+struct jpeg_push_source {
+	struct jpeg_source_mgr pub;
+	JOCTET *buffer;
+	size_t buffer_size;
+	size_t skip;
+	long long bytes_pushed;
+	boolean eof;
+};
+
+void jpeg_push_src(j_decompress_ptr cinfo, struct jpeg_push_source *src);
+int jpeg_push_data(struct jpeg_push_source *src, const JOCTET *data, size_t len);
+void jpeg_push_eof(struct jpeg_push_source *src);
+void jpeg_push_free(struct jpeg_push_source *src);
+
+
+#endif /* JPEGPUSH_H */
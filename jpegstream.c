@@ -0,0 +1,162 @@
+/* jpegstream.c - constant memory streaming source manager for libjpeg
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <jpeglib.h>
+#include <jerror.h>
+
+#include "jpegstream.h"
+
+
+/*
+ * Source manager that reads input through a fixed size buffer, so that
+ * memory use does not depend on the size of the input. All bytes read
+ * are passed through the (optional) message-digest context on the way.
+ */
+
+static size_t stream_read(struct jpeg_stream_source *src)
+{
+	if (src->eof)
+		return 0;
+
+	size_t len = fread(src->buffer, 1, src->buffer_size, src->infile);
+	if (len < src->buffer_size)
+		src->eof = TRUE;
+	if (len > 0) {
+		src->bytes_read += len;
+		if (src->digest)
+			digest_update(src->digest, src->buffer, len);
+	}
+
+	return len;
+}
+
+
+static void init_source(j_decompress_ptr cinfo)
+{
+	/* nothing to do */
+}
+
+
+static boolean fill_input_buffer(j_decompress_ptr cinfo)
+{
+	struct jpeg_stream_source *src = (struct jpeg_stream_source*)cinfo->src;
+	static const JOCTET fake_eoi[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
+	size_t len = stream_read(src);
+
+	if (len == 0) {
+		if (ferror(src->infile))
+			ERREXIT(cinfo, JERR_FILE_READ);
+		/* Insert a fake EOI marker (same as libjpeg own source managers) */
+		WARNMS(cinfo, JWRN_JPEG_EOF);
+		src->pub.next_input_byte = fake_eoi;
+		src->pub.bytes_in_buffer = 2;
+		return TRUE;
+	}
+
+	src->pub.next_input_byte = src->buffer;
+	src->pub.bytes_in_buffer = len;
+
+	return TRUE;
+}
+
+
+static void skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+	struct jpeg_source_mgr *src = cinfo->src;
+	struct jpeg_stream_source *ssrc = (struct jpeg_stream_source*)cinfo->src;
+
+	if (num_bytes <= 0)
+		return;
+
+	/* Without digest, skipped data need not be read at all (if input is seekable) */
+	if (!ssrc->digest && !ssrc->eof && num_bytes > (long)src->bytes_in_buffer) {
+		long ahead = num_bytes - (long)src->bytes_in_buffer;
+		if (fseek(ssrc->infile, ahead, SEEK_CUR) == 0) {
+			ssrc->bytes_read += ahead;
+			src->next_input_byte += src->bytes_in_buffer;
+			src->bytes_in_buffer = 0;
+			return;
+		}
+	}
+
+	while (num_bytes > (long)src->bytes_in_buffer) {
+		num_bytes -= (long)src->bytes_in_buffer;
+		(void)(*src->fill_input_buffer)(cinfo);
+	}
+	src->next_input_byte += num_bytes;
+	src->bytes_in_buffer -= num_bytes;
+}
+
+
+static void term_source(j_decompress_ptr cinfo)
+{
+	/* nothing to do */
+}
+
+
+void jpeg_stream_src(j_decompress_ptr cinfo, struct jpeg_stream_source *src,
+		FILE *infile, JOCTET *buffer, size_t buffer_size,
+		struct digest_ctx *digest)
+{
+	if (!cinfo || !src || !infile || !buffer)
+		return;
+
+	memset(src, 0, sizeof(struct jpeg_stream_source));
+	src->pub.init_source = init_source;
+	src->pub.fill_input_buffer = fill_input_buffer;
+	src->pub.skip_input_data = skip_input_data;
+	src->pub.resync_to_restart = jpeg_resync_to_restart;
+	src->pub.term_source = term_source;
+	src->pub.bytes_in_buffer = 0;
+	src->pub.next_input_byte = NULL;
+	src->infile = infile;
+	src->buffer = buffer;
+	src->buffer_size = buffer_size;
+	src->digest = digest;
+	src->bytes_read = 0;
+	src->eof = FALSE;
+
+	cinfo->src = &src->pub;
+}
+
+
+/* Read rest of the input (to update message-digest and byte count). */
+long long jpeg_stream_drain(struct jpeg_stream_source *src)
+{
+	if (!src)
+		return -1;
+
+	while (stream_read(src) > 0)
+		;
+
+	return src->bytes_read;
+}
+
+/* eof :-) */
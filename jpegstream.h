@@ -0,0 +1,30 @@
+/* jpegstream.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef JPEGSTREAM_H
+#define JPEGSTREAM_H 1
+
+#include "digest.h"
+
+#define STREAM_BUFFER_SIZE (64 * 1024)
+
+struct jpeg_stream_source {
+	struct jpeg_source_mgr pub;
+	FILE *infile;
+	JOCTET *buffer;
+	size_t buffer_size;
+	struct digest_ctx *digest;
+	long long bytes_read;
+	boolean eof;
+};
+
+void jpeg_stream_src(j_decompress_ptr cinfo, struct jpeg_stream_source *src,
+		FILE *infile, JOCTET *buffer, size_t buffer_size,
+		struct digest_ctx *digest);
+long long jpeg_stream_drain(struct jpeg_stream_source *src);
+
+
+#endif /* JPEGSTREAM_H */
@@ -88,6 +88,8 @@ char *fgetstr(char *s, size_t size, FILE *stream)
 }
 
 
+static const char hex_digits[] = "0123456789abcdef";
+
 char *digest2str(unsigned char *digest, char *s, unsigned int len)
 {
 	char *output = s;
@@ -95,11 +97,11 @@ char *digest2str(unsigned char *digest, char *s, unsigned int len)
 	if (!digest || !s)
 		return NULL;
 
-	*output = 0;
 	for (int i = 0; i < len; i++) {
-		snprintf(output, 3, "%02x", digest[i]);
-		output += 2;
+		*output++ = hex_digits[digest[i] >> 4];
+		*output++ = hex_digits[digest[i] & 0x0f];
 	}
+	*output = 0;
 
 	return s;
 }
@@ -179,38 +181,39 @@ char *str_add_list(char *dst, size_t size, const char *src, const char *delim)
 }
 
 
-char *escape_str(const char *src, char c, char e)
+/* Parse size with optional (binary) suffix: k, M, G or T */
+int parse_size(const char *s, long long *size)
 {
-	char *dst, *d;
-	size_t src_len = 0;
-	size_t escapes = 0;
+	char *end;
 
-	if (!src)
-		return NULL;
-
-	/* Count how many bytes longer the new string will be... */
-	if (c) {
-		src_len = strlen(src);
-		for (int i = 0; i < src_len; i++) {
-			if (src[i] == c)
-				escapes++;
-		}
-	}
+	if (!s || !size)
+		return -1;
 
-	if (escapes > 0) {
-		/* Allocate longer string... */
-		if (!(dst = calloc(1, src_len + escapes + 1)))
-			return NULL;
-		d = dst;
-		for (int i = 0; i < src_len; i++) {
-			if (src[i] == c)
-				*d++ = e;
-			*d++ = src[i];
-		}
-	} else {
-		/* Nothing to do, duplicate source string... */
-		dst = strdup(src);
+	long long v = strtoll(s, &end, 10);
+	if (end == s || v < 0)
+		return -1;
+	switch (*end) {
+	case 'k':
+	case 'K':
+		v *= 1024LL;
+		end++;
+		break;
+	case 'M':
+		v *= 1024LL * 1024;
+		end++;
+		break;
+	case 'G':
+		v *= 1024LL * 1024 * 1024;
+		end++;
+		break;
+	case 'T':
+		v *= 1024LL * 1024 * 1024 * 1024;
+		end++;
+		break;
 	}
+	if (*end)
+		return -1;
 
-	return dst;
+	*size = v;
+	return 0;
 }
@@ -0,0 +1,314 @@
+/* outbuf.c - growable output buffer and fast record formatting
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "jpeginfo.h"
+#include "outbuf.h"
+
+
+/*
+ * Records are formatted into a growable buffer (one per process) and
+ * passed to stdio with a single fwrite(), instead of a series of printf()
+ * calls per record. Output streams that are not terminals get a large
+ * stdio buffer, so output is written using few large write() calls.
+ */
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+#define SWAR_ZERO(v)    (((v) - ONES) & ~(v) & HIGHS)
+#define SWAR_LESS(v, n) (((v) - ONES * (n)) & ~(v) & HIGHS)
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* JSON escapes: 0 = no escaping needed, 'u' = \u00XX, otherwise \<char> */
+static const char json_escapes[256] = {
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+	'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+	['"'] = '"',
+	['\\'] = '\\',
+};
+
+/* Text escapes: 0 = no escaping needed, 'x' = \xXX, otherwise \<char> */
+static const char text_escapes[256] = {
+	'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 't', 'n', 'x', 'x', 'r', 'x', 'x',
+	'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x', 'x',
+	['\\'] = '\\',
+	[0x7f] = 'x',
+};
+
+
+void outbuf_init(struct outbuf *ob)
+{
+	if (!ob)
+		return;
+
+	memset(ob, 0, sizeof(struct outbuf));
+}
+
+
+void outbuf_free(struct outbuf *ob)
+{
+	if (!ob)
+		return;
+
+	free(ob->buf);
+	memset(ob, 0, sizeof(struct outbuf));
+}
+
+
+/* Make room for (at least) len more bytes, returns pointer to end of buffer */
+char *outbuf_reserve(struct outbuf *ob, size_t len)
+{
+	if (ob->len + len > ob->size) {
+		size_t size = (ob->size > 0 ? ob->size : OUTBUF_MIN_SIZE);
+
+		while (size < ob->len + len)
+			size *= 2;
+		char *buf = realloc(ob->buf, size);
+		if (!buf)
+			no_memory();
+		ob->buf = buf;
+		ob->size = size;
+	}
+
+	return ob->buf + ob->len;
+}
+
+
+void outbuf_write(struct outbuf *ob, const char *s, size_t len)
+{
+	if (len == 0)
+		return;
+
+	memcpy(outbuf_reserve(ob, len), s, len);
+	ob->len += len;
+}
+
+
+void outbuf_puts(struct outbuf *ob, const char *s)
+{
+	if (s)
+		outbuf_write(ob, s, strlen(s));
+}
+
+
+void outbuf_putc(struct outbuf *ob, char c)
+{
+	*outbuf_reserve(ob, 1) = c;
+	ob->len++;
+}
+
+
+/* Output string left justified in a field of given width (like "%-*s") */
+void outbuf_pad(struct outbuf *ob, const char *s, int width)
+{
+	size_t len = (s ? strlen(s) : 0);
+
+	outbuf_write(ob, s, len);
+	if (width > 0 && len < (size_t)width) {
+		memset(outbuf_reserve(ob, width - len), ' ', width - len);
+		ob->len += width - len;
+	}
+}
+
+
+/* Output integer right justified in a field of given width (like "%*lld") */
+void outbuf_num(struct outbuf *ob, long long val, int width)
+{
+	char tmp[24];
+	char *p = tmp + sizeof(tmp);
+	unsigned long long v = (val < 0 ? -(unsigned long long)val : val);
+
+	do {
+		*--p = '0' + v % 10;
+		v /= 10;
+	} while (v > 0);
+	if (val < 0)
+		*--p = '-';
+
+	int len = tmp + sizeof(tmp) - p;
+	if (len < width) {
+		memset(outbuf_reserve(ob, width - len), ' ', width - len);
+		ob->len += width - len;
+	}
+	outbuf_write(ob, p, len);
+}
+
+
+/* Return length of the prefix of s that needs no escaping in JSON strings */
+static size_t json_plain_len(const unsigned char *s, size_t len)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	const __m128i ctrl = _mm_set1_epi8(0x1f);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+		__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+						_mm_cmpeq_epi8(v, bslash)),
+					_mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+		int mask = _mm_movemask_epi8(m);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+	for (; i + 8 <= len; i += 8) {
+		uint64_t v;
+		memcpy(&v, s + i, 8);
+		if (SWAR_ZERO(v ^ (ONES * '"')) | SWAR_ZERO(v ^ (ONES * '\\'))
+			| SWAR_LESS(v, 0x20))
+			break;
+	}
+	while (i < len && !json_escapes[s[i]])
+		i++;
+
+	return i;
+}
+
+
+/* Output string escaped for JSON (without the enclosing quotes) */
+void outbuf_json(struct outbuf *ob, const char *s)
+{
+	const unsigned char *p = (const unsigned char*)s;
+	size_t len = (s ? strlen(s) : 0);
+
+	while (len > 0) {
+		size_t n = json_plain_len(p, len);
+
+		outbuf_write(ob, (const char*)p, n);
+		if (n == len)
+			break;
+
+		char e = json_escapes[p[n]];
+		char *d = outbuf_reserve(ob, 6);
+		d[0] = '\\';
+		d[1] = e;
+		if (e == 'u') {
+			d[2] = '0';
+			d[3] = '0';
+			d[4] = hex_digits[p[n] >> 4];
+			d[5] = hex_digits[p[n] & 0x0f];
+			ob->len += 6;
+		} else {
+			ob->len += 2;
+		}
+		p += n + 1;
+		len -= n + 1;
+	}
+}
+
+
+/*
+ * Output string with control characters (and backslash) escaped C style,
+ * so that it cannot break lines or (tab separated) columns of the output.
+ */
+void outbuf_text(struct outbuf *ob, const char *s)
+{
+	const unsigned char *p = (const unsigned char*)s;
+	const unsigned char *start = p;
+
+	if (!s)
+		return;
+
+	for (; *p; p++) {
+		char e = text_escapes[*p];
+		if (!e)
+			continue;
+
+		outbuf_write(ob, (const char*)start, p - start);
+		char *d = outbuf_reserve(ob, 4);
+		d[0] = '\\';
+		d[1] = e;
+		if (e == 'x') {
+			d[2] = hex_digits[*p >> 4];
+			d[3] = hex_digits[*p & 0x0f];
+			ob->len += 4;
+		} else {
+			ob->len += 2;
+		}
+		start = p + 1;
+	}
+	outbuf_write(ob, (const char*)start, p - start);
+}
+
+
+/* Output string escaped for CSV (without the enclosing quotes) */
+void outbuf_csv(struct outbuf *ob, const char *s)
+{
+	size_t len = (s ? strlen(s) : 0);
+	const char *q;
+
+	while ((q = memchr(s, '"', len))) {
+		outbuf_write(ob, s, q - s + 1);
+		outbuf_putc(ob, '"');
+		len -= q - s + 1;
+		s = q + 1;
+	}
+	outbuf_write(ob, s, len);
+}
+
+
+/* Write buffer contents to (stdio) stream and empty the buffer */
+int outbuf_flush(struct outbuf *ob, FILE *out)
+{
+	int r = 0;
+
+	if (ob->len > 0 && fwrite(ob->buf, 1, ob->len, out) != ob->len)
+		r = -1;
+	ob->len = 0;
+
+	return r;
+}
+
+
+/* Use large buffer for the (main) output stream, unless it is a terminal */
+void outbuf_stream(FILE *out)
+{
+	static char stream_buffer[OUTBUF_STREAM_SIZE];
+	static int in_use = 0;
+
+	if (!out || in_use || isatty(fileno(out)))
+		return;
+
+	if (setvbuf(out, stream_buffer, _IOFBF, sizeof(stream_buffer)) == 0)
+		in_use = 1;
+}
+
+/* eof :-) */
@@ -0,0 +1,36 @@
+/* outbuf.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef OUTBUF_H
+#define OUTBUF_H 1
+
+#include <stdio.h>
+
+#define OUTBUF_MIN_SIZE    1024
+#define OUTBUF_STREAM_SIZE (256 * 1024)
+
+struct outbuf {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+void outbuf_init(struct outbuf *ob);
+void outbuf_free(struct outbuf *ob);
+char *outbuf_reserve(struct outbuf *ob, size_t len);
+void outbuf_write(struct outbuf *ob, const char *s, size_t len);
+void outbuf_puts(struct outbuf *ob, const char *s);
+void outbuf_putc(struct outbuf *ob, char c);
+void outbuf_pad(struct outbuf *ob, const char *s, int width);
+void outbuf_num(struct outbuf *ob, long long val, int width);
+void outbuf_json(struct outbuf *ob, const char *s);
+void outbuf_text(struct outbuf *ob, const char *s);
+void outbuf_csv(struct outbuf *ob, const char *s);
+int outbuf_flush(struct outbuf *ob, FILE *out);
+void outbuf_stream(FILE *out);
+
+
+#endif /* OUTBUF_H */
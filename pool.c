@@ -0,0 +1,455 @@
+/* pool.c - crash isolated pool of worker processes for batch processing
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "jpeginfo.h"
+#include "server.h"
+#include "pool.h"
+#include "sink.h"
+
+
+/*
+ * Coordinator hands out paths to worker processes in small batches over
+ * pipes, and collects (serialized) results back from them. Results are
+ * passed on in the same order the paths were received. If a worker dies,
+ * the file it was working on is reported as crashed, rest of its batch
+ * is handed out again, and a new worker is started in its place.
+ */
+
+enum item_states { ITEM_FREE = 0, ITEM_QUEUED, ITEM_DONE, ITEM_CRASHED };
+
+struct pool_item {
+	char *path;
+	unsigned char *result;
+	size_t len;
+	int state;
+};
+
+struct pool_worker {
+	pid_t pid;
+	int req_fd;
+	int resp_fd;
+	long queue[POOL_BATCH];
+	int queued;
+	size_t queued_bytes;
+	unsigned char *buf;
+	size_t size;
+	size_t len;
+};
+
+static struct pool_item *items = NULL;
+static struct pool_worker *pool = NULL;
+static int pool_size = 0;
+static long *retry = NULL;
+static int retry_count = 0;
+
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+
+static void worker_main(int req_fd, int resp_fd, long long mem_limit, pool_work_fn work)
+{
+	char *path = NULL;
+	size_t path_size = 0;
+	uint32_t len;
+
+	signal(SIGPIPE, SIG_DFL);
+
+	if (mem_limit > 0) {
+		struct rlimit rl = { mem_limit, mem_limit };
+		if (setrlimit(RLIMIT_AS, &rl) < 0)
+			fprintf(stderr, "jpeginfo: setrlimit() failed: %s\n", strerror(errno));
+	}
+
+	while (read_full(req_fd, &len, sizeof(len)) == 0) {
+		if (len + 1 > path_size) {
+			path_size = len + 1;
+			if (!(path = realloc(path, path_size)))
+				no_memory();
+		}
+		if (read_full(req_fd, path, len) < 0)
+			break;
+		path[len] = 0;
+
+		const unsigned char *result = NULL;
+		uint32_t rlen = work(path, &result);
+		if (write_all(resp_fd, &rlen, sizeof(rlen)) < 0 ||
+			write_all(resp_fd, result, rlen) < 0)
+			break;
+	}
+
+	exit(0);
+}
+
+
+static int start_worker(struct pool_worker *w, long long mem_limit, pool_work_fn work)
+{
+	int req[2], resp[2];
+
+	if (pipe(req) < 0)
+		return -1;
+	if (pipe(resp) < 0) {
+		close(req[0]);
+		close(req[1]);
+		return -1;
+	}
+
+	fflush(NULL);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "jpeginfo: fork() failed: %s\n", strerror(errno));
+		close(req[0]);
+		close(req[1]);
+		close(resp[0]);
+		close(resp[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		/* Do not hold on to pipes of other workers */
+		for (int i = 0; i < pool_size; i++) {
+			if (pool[i].pid > 0) {
+				close(pool[i].req_fd);
+				close(pool[i].resp_fd);
+			}
+		}
+		/* ...nor to output sinks (writer must see EOF when main process exits) */
+		sink_close_fds();
+		close(req[1]);
+		close(resp[0]);
+		worker_main(req[0], resp[1], mem_limit, work);
+	}
+
+	close(req[0]);
+	close(resp[1]);
+	w->pid = pid;
+	w->req_fd = req[1];
+	w->resp_fd = resp[0];
+	w->queued = 0;
+	w->queued_bytes = 0;
+	w->len = 0;
+
+	return 0;
+}
+
+
+static void stop_worker(struct pool_worker *w)
+{
+	if (w->pid <= 0)
+		return;
+
+	if (w->req_fd >= 0)
+		close(w->req_fd);
+	close(w->resp_fd);
+	w->pid = -1;
+	w->req_fd = w->resp_fd = -1;
+	w->queued = 0;
+	w->queued_bytes = 0;
+	w->len = 0;
+}
+
+
+/* Return sequence number of next item to hand out, or -1 if none available */
+static long next_item(long *next_seq, long out_seq, bool *input_done, pool_next_fn next)
+{
+	if (retry_count > 0) {
+		long seq = retry[0];
+		memmove(retry, retry + 1, --retry_count * sizeof(long));
+		return seq;
+	}
+	if (*input_done || *next_seq - out_seq >= POOL_WINDOW)
+		return -1;
+
+	const char *path = next();
+	if (!path) {
+		*input_done = true;
+		return -1;
+	}
+
+	struct pool_item *item = &items[*next_seq % POOL_WINDOW];
+	if (!(item->path = strdup(path)))
+		no_memory();
+	item->result = NULL;
+	item->len = 0;
+	item->state = ITEM_QUEUED;
+
+	return (*next_seq)++;
+}
+
+
+static int send_item(struct pool_worker *w, long seq)
+{
+	const char *path = items[seq % POOL_WINDOW].path;
+	uint32_t len = strlen(path);
+
+	if (write_all(w->req_fd, &len, sizeof(len)) < 0 ||
+		write_all(w->req_fd, path, len) < 0)
+		return -1;
+
+	w->queue[w->queued++] = seq;
+	w->queued_bytes += sizeof(len) + len;
+
+	return 0;
+}
+
+
+/* Read (available) results from a worker, returns -1 if worker has died */
+static int read_results(struct pool_worker *w)
+{
+	if (w->size - w->len < 64 * 1024) {
+		w->size = (w->size > 0 ? w->size * 2 : 128 * 1024);
+		if (!(w->buf = realloc(w->buf, w->size)))
+			no_memory();
+	}
+
+	ssize_t n = read(w->resp_fd, w->buf + w->len, w->size - w->len);
+	if (n < 0 && errno == EINTR)
+		return 0;
+	if (n <= 0)
+		return -1;
+	w->len += n;
+
+	size_t pos = 0;
+	while (w->len - pos >= sizeof(uint32_t) && w->queued > 0) {
+		uint32_t len;
+		memcpy(&len, w->buf + pos, sizeof(len));
+		if (w->len - pos - sizeof(len) < len)
+			break;
+
+		long seq = w->queue[0];
+		struct pool_item *item = &items[seq % POOL_WINDOW];
+		if (len > 0) {
+			if (!(item->result = malloc(len)))
+				no_memory();
+			memcpy(item->result, w->buf + pos + sizeof(len), len);
+		}
+		item->len = len;
+		item->state = ITEM_DONE;
+		pos += sizeof(len) + len;
+
+		w->queued_bytes -= sizeof(uint32_t) + strlen(item->path);
+		memmove(w->queue, w->queue + 1, --w->queued * sizeof(long));
+	}
+	if (pos > 0) {
+		memmove(w->buf, w->buf + pos, w->len - pos);
+		w->len -= pos;
+	}
+
+	return 0;
+}
+
+
+/* Handle worker that has died: report crash and hand out rest of its batch */
+static void worker_died(struct pool_worker *w)
+{
+	int status = 0;
+
+	if (w->pid <= 0)
+		return;
+
+	/* Collect results worker wrote before it went away, so that only items
+	   still in flight are handed out again (a live worker exits on EOF) */
+	close(w->req_fd);
+	w->req_fd = -1;
+	while (w->queued > 0 && read_results(w) == 0)
+		;
+
+	while (waitpid(w->pid, &status, 0) < 0 && errno == EINTR)
+		;
+
+	if (w->queued > 0) {
+		struct pool_item *item = &items[w->queue[0] % POOL_WINDOW];
+
+		if (WIFSIGNALED(status))
+			fprintf(stderr, "jpeginfo: worker crashed (signal %d) processing '%s'\n",
+				WTERMSIG(status), item->path);
+		else
+			fprintf(stderr, "jpeginfo: worker exited (status %d) processing '%s'\n",
+				WEXITSTATUS(status), item->path);
+		item->state = ITEM_CRASHED;
+
+		int requeue = w->queued - 1;
+		memmove(retry + requeue, retry, retry_count * sizeof(long));
+		memcpy(retry, w->queue + 1, requeue * sizeof(long));
+		retry_count += requeue;
+	}
+
+	stop_worker(w);
+}
+
+
+int pool_run(int workers, long long mem_limit, pool_next_fn next, pool_work_fn work,
+	pool_result_fn result, volatile sig_atomic_t *stop)
+{
+	struct pollfd *pfds;
+	long next_seq = 0, out_seq = 0;
+	bool input_done = false;
+	int ret = 0;
+
+	if (!next || !work || !result)
+		return -1;
+	if (workers < 1)
+		workers = 1;
+
+	pool_size = workers;
+	items = calloc(POOL_WINDOW, sizeof(struct pool_item));
+	pool = calloc(workers, sizeof(struct pool_worker));
+	retry = calloc(workers * POOL_BATCH + 1, sizeof(long));
+	pfds = calloc(workers, sizeof(struct pollfd));
+	if (!items || !pool || !retry || !pfds)
+		no_memory();
+
+	signal(SIGPIPE, SIG_IGN);
+
+	for (int i = 0; i < workers; i++) {
+		pool[i].pid = -1;
+		if (start_worker(&pool[i], mem_limit, work) < 0) {
+			ret = -1;
+			goto out;
+		}
+	}
+
+	while (!(stop && *stop)) {
+		/* Keep workers busy */
+		for (int i = 0; i < workers; i++) {
+			struct pool_worker *w = &pool[i];
+
+			if (w->pid <= 0 && start_worker(w, mem_limit, work) < 0) {
+				ret = -1;
+				goto out;
+			}
+			while (w->queued < POOL_BATCH &&
+				(w->queued == 0 || w->queued_bytes < POOL_PIPE_LIMIT)) {
+				long seq = next_item(&next_seq, out_seq, &input_done, next);
+				if (seq < 0)
+					break;
+				if (send_item(w, seq) < 0) {
+					/* Worker is gone, hand out the item again */
+					memmove(retry + 1, retry, retry_count++ * sizeof(long));
+					retry[0] = seq;
+					worker_died(w);
+					break;
+				}
+			}
+		}
+
+		/* Pass on completed results (in order) */
+		while (out_seq < next_seq && items[out_seq % POOL_WINDOW].state >= ITEM_DONE) {
+			struct pool_item *item = &items[out_seq % POOL_WINDOW];
+
+			result(item->path, item->result, item->len, item->state == ITEM_CRASHED);
+			free(item->path);
+			free(item->result);
+			memset(item, 0, sizeof(struct pool_item));
+			out_seq++;
+		}
+		if (input_done && out_seq == next_seq && retry_count == 0)
+			break;
+
+		/* Wait for results */
+		int count = 0;
+		for (int i = 0; i < workers; i++) {
+			pfds[i].fd = (pool[i].queued > 0 ? pool[i].resp_fd : -1);
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+			if (pool[i].queued > 0)
+				count++;
+		}
+		if (count == 0)
+			continue;
+		if (poll(pfds, workers, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "jpeginfo: poll() failed: %s\n", strerror(errno));
+			ret = -1;
+			break;
+		}
+		for (int i = 0; i < workers; i++) {
+			if (pfds[i].revents && read_results(&pool[i]) < 0)
+				worker_died(&pool[i]);
+		}
+	}
+
+ out:
+	for (int i = 0; i < workers; i++) {
+		if (pool[i].pid <= 0)
+			continue;
+		if (stop && *stop)
+			kill(pool[i].pid, SIGTERM);
+		pid_t pid = pool[i].pid;
+		stop_worker(&pool[i]);
+		while (waitpid(pid, NULL, 0) < 0 && errno == EINTR)
+			;
+	}
+	for (int i = 0; i < POOL_WINDOW; i++) {
+		free(items[i].path);
+		free(items[i].result);
+	}
+	for (int i = 0; i < workers; i++)
+		free(pool[i].buf);
+	free(items);
+	free(pool);
+	free(retry);
+	free(pfds);
+	items = NULL;
+	pool = NULL;
+	retry = NULL;
+	retry_count = pool_size = 0;
+
+	return ret;
+}
+
+/* eof :-) */
@@ -0,0 +1,26 @@
+/* pool.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef POOL_H
+#define POOL_H 1
+
+#include <signal.h>
+#include <stdbool.h>
+
+#define POOL_BATCH       16          /* max paths queued per worker */
+#define POOL_PIPE_LIMIT  (32 * 1024) /* max bytes queued per worker */
+#define POOL_WINDOW      4096        /* max paths in flight (result ordering) */
+
+typedef const char *(*pool_next_fn)(void);
+typedef size_t (*pool_work_fn)(const char *path, const unsigned char **result);
+typedef void (*pool_result_fn)(const char *path, const unsigned char *result, size_t len,
+	bool crashed);
+
+int pool_run(int workers, long long mem_limit, pool_next_fn next, pool_work_fn work,
+	pool_result_fn result, volatile sig_atomic_t *stop);
+
+
+#endif /* POOL_H */
@@ -0,0 +1,322 @@
+/* queue.c - cooperative work queue on a shared filesystem
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "jpeginfo.h"
+#include "queue.h"
+
+
+/*
+ * Queue directory layout:
+ *
+ *   todo/<batch>              batches (lists of files) waiting to be processed
+ *   claimed/<batch>@<owner>   batches being processed, mtime is the lease
+ *   done/<batch>              batches that have been processed
+ *   results/<batch><ext>      output for each processed batch
+ *
+ * Batches are claimed by renaming them (rename is atomic, so only one
+ * instance can succeed). The owner keeps its lease alive by touching the
+ * claimed file, and batches whose lease has expired are claimed again
+ * (again by renaming) by other instances.
+ */
+
+static const char *subdirs[] = { "todo", "claimed", "done", "results", NULL };
+
+
+static char *queue_path(struct work_queue *q, const char *subdir, const char *name,
+			const char *suffix)
+{
+	if (snprintf(q->pathbuf, sizeof(q->pathbuf), "%s/%s/%s%s", q->dir, subdir, name,
+			(suffix ? suffix : "")) >= sizeof(q->pathbuf))
+		fprintf(stderr, "jpeginfo: queue path too long: %s/%s\n", q->dir, subdir);
+	return q->pathbuf;
+}
+
+
+int queue_init(struct work_queue *q, const char *dir, int lease)
+{
+	char host[64];
+	char path[MAXPATHLEN + 32];
+
+	if (!q || !dir)
+		return -1;
+
+	memset(q, 0, sizeof(struct work_queue));
+	strncopy(q->dir, dir, sizeof(q->dir));
+	q->lease = (lease > 0 ? lease : QUEUE_DEFAULT_LEASE);
+
+	if (gethostname(host, sizeof(host)) < 0)
+		strncopy(host, "localhost", sizeof(host));
+	host[sizeof(host) - 1] = 0;
+	snprintf(q->owner, sizeof(q->owner), "%s.%ld", host, (long)getpid());
+
+	mkdir(dir, 0777);
+	for (int i = 0; subdirs[i]; i++) {
+		snprintf(path, sizeof(path), "%s/%s", dir, subdirs[i]);
+		if (mkdir(path, 0777) < 0 && errno != EEXIST) {
+			fprintf(stderr, "jpeginfo: cannot create '%s': %s\n", path, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Add batch of files into the queue */
+int queue_add_batch(struct work_queue *q, const char **paths, size_t n)
+{
+	char name[256], tmp[MAXPATHLEN + 512];
+
+	if (!q || !paths || n < 1)
+		return 0;
+
+	snprintf(name, sizeof(name), "b%lld-%s-%06ld", (long long)time(NULL), q->owner,
+		q->batches++);
+	snprintf(tmp, sizeof(tmp), "%s/todo/.%s", q->dir, name);
+
+	FILE *fp = fopen(tmp, "w");
+	if (!fp) {
+		fprintf(stderr, "jpeginfo: cannot create '%s': %s\n", tmp, strerror(errno));
+		return -1;
+	}
+	/* Names are NUL separated (names may contain newlines) */
+	for (size_t i = 0; i < n; i++)
+		fwrite(paths[i], 1, strlen(paths[i]) + 1, fp);
+	if (fclose(fp) == EOF || rename(tmp, queue_path(q, "todo", name, NULL)) < 0) {
+		fprintf(stderr, "jpeginfo: cannot add batch '%s': %s\n", name, strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* Take over batch (from todo or expired claim) by renaming it. */
+static int claim(struct work_queue *q, const char *from, const char *batch)
+{
+	char target[MAXPATHLEN + 512];
+
+	snprintf(target, sizeof(target), "%s/claimed/%s@%s", q->dir, batch, q->owner);
+	if (rename(from, target) < 0)
+		return -1;
+
+	/* Start lease now (rename preserves modification time) */
+	utime(target, NULL);
+	strncopy(q->batch, batch, sizeof(q->batch));
+	strncopy(q->claimed, target, sizeof(q->claimed));
+	q->last_touch = time(NULL);
+
+	return 0;
+}
+
+
+/* Try to claim a batch from todo directory, returns 1 on success. */
+static int claim_todo(struct work_queue *q)
+{
+	char from[MAXPATHLEN + 512];
+	struct dirent *de;
+	int ret = 0;
+
+	DIR *d = opendir(queue_path(q, "todo", "", NULL));
+	if (!d)
+		return -1;
+
+	while (!ret && (de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(from, sizeof(from), "%s/todo/%s", q->dir, de->d_name);
+		if (claim(q, from, de->d_name) == 0)
+			ret = 1;
+	}
+	closedir(d);
+
+	return ret;
+}
+
+
+/*
+ * Try to claim an expired batch from claimed directory, returns 1 on success.
+ * Sets *active if there are batches with valid lease (claimed by others).
+ */
+static int claim_expired(struct work_queue *q, int *active)
+{
+	char from[MAXPATHLEN + 512], batch[256];
+	struct dirent *de;
+	struct stat st;
+	time_t now = time(NULL);
+	int ret = 0;
+
+	*active = 0;
+	DIR *d = opendir(queue_path(q, "claimed", "", NULL));
+	if (!d)
+		return -1;
+
+	while (!ret && (de = readdir(d))) {
+		char *at = strrchr(de->d_name, '@');
+		if (de->d_name[0] == '.' || !at || at - de->d_name >= sizeof(batch))
+			continue;
+		snprintf(from, sizeof(from), "%s/claimed/%s", q->dir, de->d_name);
+		if (stat(from, &st) < 0)
+			continue;
+		if (now - st.st_mtime < q->lease) {
+			*active = 1;
+			continue;
+		}
+		strncopy(batch, de->d_name, at - de->d_name + 1);
+		if (claim(q, from, batch) == 0) {
+			fprintf(stderr, "jpeginfo: reclaimed expired batch '%s' (from %s)\n",
+				batch, at + 1);
+			ret = 1;
+		}
+	}
+	closedir(d);
+
+	return ret;
+}
+
+
+/*
+ * Claim next batch to process. Waits for batches claimed by other instances
+ * (in case their lease expires). Returns 1 if batch was claimed, 0 if queue
+ * is finished, and -1 on errors.
+ */
+int queue_claim(struct work_queue *q, volatile sig_atomic_t *stop)
+{
+	int active, r;
+
+	if (!q)
+		return -1;
+
+	q->batch[0] = q->claimed[0] = 0;
+
+	while (!(stop && *stop)) {
+		if ((r = claim_todo(q)) != 0)
+			return r;
+		if ((r = claim_expired(q, &active)) != 0)
+			return r;
+		if (!active)
+			return 0;
+		sleep(QUEUE_POLL_INTERVAL);
+	}
+
+	return 0;
+}
+
+
+/* Return path of the currently claimed batch file */
+const char *queue_batch_file(struct work_queue *q)
+{
+	return (q && q->claimed[0] ? q->claimed : NULL);
+}
+
+
+/* Keep lease of current batch alive (called periodically) */
+void queue_touch(struct work_queue *q)
+{
+	if (!q || !q->claimed[0])
+		return;
+
+	time_t now = time(NULL);
+	if (now - q->last_touch < q->lease / 4)
+		return;
+	if (utime(q->claimed, NULL) < 0 && errno == ENOENT)
+		fprintf(stderr, "jpeginfo: lost lease of batch '%s'\n", q->batch);
+	q->last_touch = now;
+}
+
+
+/* Return (temporary) path for the results of current batch */
+const char *queue_result_file(struct work_queue *q, const char *ext, int tmp)
+{
+	char name[512];
+
+	if (!q || !q->batch[0])
+		return NULL;
+
+	if (tmp) {
+		snprintf(name, sizeof(name), ".%s@%s", q->batch, q->owner);
+		return queue_path(q, "results", name, ext);
+	}
+
+	return queue_path(q, "results", q->batch, ext);
+}
+
+
+/* Mark current batch done (results have been written into tmp_result) */
+int queue_complete(struct work_queue *q, const char *ext)
+{
+	char tmp[MAXPATHLEN + 512];
+
+	if (!q || !q->batch[0])
+		return -1;
+
+	strncopy(tmp, queue_result_file(q, ext, 1), sizeof(tmp));
+	if (rename(tmp, queue_result_file(q, ext, 0)) < 0 ||
+		rename(q->claimed, queue_path(q, "done", q->batch, NULL)) < 0) {
+		fprintf(stderr, "jpeginfo: failed to complete batch '%s': %s\n",
+			q->batch, strerror(errno));
+		return -1;
+	}
+	q->batch[0] = q->claimed[0] = 0;
+
+	return 0;
+}
+
+
+
+/* Return unfinished batch back into todo directory (for others to process) */
+int queue_release(struct work_queue *q, const char *ext)
+{
+	if (!q || !q->batch[0])
+		return -1;
+
+	unlink(queue_result_file(q, ext, 1));
+	if (rename(q->claimed, queue_path(q, "todo", q->batch, NULL)) < 0) {
+		fprintf(stderr, "jpeginfo: failed to release batch '%s': %s\n",
+			q->batch, strerror(errno));
+		return -1;
+	}
+	q->batch[0] = q->claimed[0] = 0;
+
+	return 0;
+}
+
+/* eof :-) */
@@ -0,0 +1,38 @@
+/* queue.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef QUEUE_H
+#define QUEUE_H 1
+
+#include <signal.h>
+#include <time.h>
+
+#define QUEUE_DEFAULT_LEASE  300  /* seconds */
+#define QUEUE_DEFAULT_BATCH  1000 /* files per batch */
+#define QUEUE_POLL_INTERVAL  5    /* seconds */
+
+struct work_queue {
+	char dir[MAXPATHLEN + 1];
+	char owner[128];
+	char batch[256];
+	char claimed[MAXPATHLEN + 512];
+	char pathbuf[MAXPATHLEN + 512];
+	int lease;
+	long batches;
+	time_t last_touch;
+};
+
+int queue_init(struct work_queue *q, const char *dir, int lease);
+int queue_add_batch(struct work_queue *q, const char **paths, size_t n);
+int queue_claim(struct work_queue *q, volatile sig_atomic_t *stop);
+const char *queue_batch_file(struct work_queue *q);
+void queue_touch(struct work_queue *q);
+const char *queue_result_file(struct work_queue *q, const char *ext, int tmp);
+int queue_complete(struct work_queue *q, const char *ext);
+int queue_release(struct work_queue *q, const char *ext);
+
+
+#endif /* QUEUE_H */
@@ -0,0 +1,423 @@
+/* sample.c - reproducible random sampling of input files and error rate estimates
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "jpeginfo.h"
+#include "sample.h"
+
+
+/*
+ * Without strata, files are selected into the sample based on a hash of the
+ * path (and seed) only, so the same seed always selects the same files
+ * regardless of input order, sharding or how the work is split between
+ * processes.
+ *
+ * With strata, files are grouped by directory or size class and selected
+ * systematically (every 1/rate:th file, from a random starting point) within
+ * each stratum, so that every stratum is represented in proportion to its
+ * size. Which files get selected then depends on the order the files of each
+ * stratum are seen (and on which of them a shard sees), so the sample is
+ * only repeatable for the same input list. Rates are estimated separately
+ * for each stratum and combined weighted by the number of input files in
+ * the stratum.
+ */
+
+
+/* Parse sampling rate given as fraction ("0.01"), percentage ("1%") or
+   ratio ("1/100") */
+int parse_sample_rate(const char *arg, double *rate)
+{
+	char *end;
+
+	if (!arg || !rate)
+		return -1;
+
+	double r = strtod(arg, &end);
+	if (end == arg)
+		return -1;
+	if (*end == '%') {
+		r /= 100.0;
+		end++;
+	} else if (*end == '/') {
+		const char *p = end + 1;
+		double d = strtod(p, &end);
+		if (end == p || d <= 0)
+			return -1;
+		r /= d;
+	}
+	if (*end || !(r > 0.0 && r <= 1.0))
+		return -1;
+
+	*rate = r;
+	return 0;
+}
+
+
+int parse_sample_strata(const char *arg, enum sample_strata *strata)
+{
+	if (!arg || !strata)
+		return -1;
+
+	if (!strcasecmp(arg, "none"))
+		*strata = STRATA_NONE;
+	else if (!strcasecmp(arg, "dir"))
+		*strata = STRATA_DIR;
+	else if (!strcasecmp(arg, "size"))
+		*strata = STRATA_SIZE;
+	else
+		return -1;
+
+	return 0;
+}
+
+
+/* Hash string (FNV-1a) and mix in the seed (splitmix64 finalizer) */
+static uint64_t hash_seed(const char *s, size_t len, uint64_t seed)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 0x100000001b3ULL;
+	}
+	h ^= seed + 0x9e3779b97f4a7c15ULL;
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+
+	return h ^ (h >> 31);
+}
+
+
+/* Map hash into uniformly distributed value in range [0,1) */
+static double hash_uniform(uint64_t h)
+{
+	return (h >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/* Return key of the stratum the file belongs to */
+static const char *stratum_key(const struct sampler *s, const char *path,
+			char *buf, size_t size)
+{
+	struct stat st;
+
+	if (s->strata == STRATA_DIR) {
+		const char *p = strrchr(path, '/');
+		if (!p)
+			return ".";
+		if (p == path)
+			return "/";
+		snprintf(buf, size, "%.*s", (int)(p - path), path);
+		return buf;
+	}
+	if (s->strata == STRATA_SIZE) {
+		static const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+		long long size_class = 1;
+		int bits = 0;
+
+		if (stat(path, &st) < 0)
+			return "unknown";
+		while (size_class <= st.st_size / 2 && bits < 40) {
+			size_class <<= 1;
+			bits++;
+		}
+		snprintf(buf, size, "%lld%s-%lld%s",
+			size_class >> (bits / 10 * 10), units[bits / 10],
+			(size_class << 1) >> (bits / 10 * 10), units[bits / 10]);
+		return buf;
+	}
+
+	return "";
+}
+
+
+static void table_resize(struct sampler *s, size_t table_size)
+{
+	size_t *table = calloc(table_size, sizeof(size_t));
+	if (!table)
+		no_memory();
+
+	for (size_t i = 0; i < s->count; i++) {
+		const char *key = s->list[i].key;
+		size_t pos = hash_seed(key, strlen(key), 0) & (table_size - 1);
+		while (table[pos])
+			pos = (pos + 1) & (table_size - 1);
+		table[pos] = i + 1;
+	}
+	free(s->table);
+	s->table = table;
+	s->table_size = table_size;
+}
+
+
+/* Find stratum by key (add new one, if create is set) */
+static struct sample_stratum *find_stratum(struct sampler *s, const char *key,
+					bool create)
+{
+	size_t len = strlen(key);
+	uint64_t h = hash_seed(key, len, 0);
+
+	if (s->table_size > 0) {
+		size_t pos = h & (s->table_size - 1);
+		while (s->table[pos]) {
+			struct sample_stratum *st = &s->list[s->table[pos] - 1];
+			if (!strcmp(st->key, key))
+				return st;
+			pos = (pos + 1) & (s->table_size - 1);
+		}
+	}
+	if (!create)
+		return NULL;
+
+	if (s->count >= s->size) {
+		s->size = (s->size > 0 ? s->size * 2 : 64);
+		if (!(s->list = realloc(s->list, sizeof(struct sample_stratum) * s->size)))
+			no_memory();
+	}
+	struct sample_stratum *st = &s->list[s->count++];
+	memset(st, 0, sizeof(struct sample_stratum));
+	if (!(st->key = strdup(key)))
+		no_memory();
+	st->phase = hash_uniform(hash_seed(key, len, s->seed));
+
+	if (s->count * 2 > s->table_size)
+		table_resize(s, (s->table_size > 0 ? s->table_size * 2 : 128));
+	else {
+		size_t pos = h & (s->table_size - 1);
+		while (s->table[pos])
+			pos = (pos + 1) & (s->table_size - 1);
+		s->table[pos] = s->count;
+	}
+
+	return st;
+}
+
+
+void sampler_init(struct sampler *s, double rate, unsigned long long seed,
+		enum sample_strata strata)
+{
+	if (!s)
+		return;
+
+	memset(s, 0, sizeof(struct sampler));
+	s->rate = rate;
+	s->seed = seed;
+	s->strata = strata;
+}
+
+
+/* Count input file and check whether it is selected into the sample */
+bool sampler_select(struct sampler *s, const char *path)
+{
+	char buf[MAXPATHLEN + 1];
+	bool selected;
+
+	if (!s || !path)
+		return false;
+
+	struct sample_stratum *st = find_stratum(s, stratum_key(s, path, buf, sizeof(buf)),
+						true);
+	if (s->strata == STRATA_NONE) {
+		selected = hash_uniform(hash_seed(path, strlen(path), s->seed)) < s->rate;
+	} else {
+		/* Systematic selection within the stratum */
+		long long k = st->population;
+		selected = floor((k + 1) * s->rate + st->phase) > floor(k * s->rate + st->phase);
+	}
+	st->population++;
+	if (selected)
+		st->selected++;
+
+	return selected;
+}
+
+
+/* Record check result (status) of a file in the sample */
+void sampler_result(struct sampler *s, const char *path, int status)
+{
+	char buf[MAXPATHLEN + 1];
+
+	if (!s || !path)
+		return;
+
+	struct sample_stratum *st = find_stratum(s, stratum_key(s, path, buf, sizeof(buf)),
+						false);
+	if (!st)
+		return;
+	st->sampled++;
+	if (status >= 0 && status < SAMPLE_CLASSES)
+		st->counts[status]++;
+}
+
+
+/*
+ * Estimate proportion of files with given status, and its confidence
+ * interval. Interval is Wilson score interval, using the effective sample
+ * size (from the stratified variance estimate) when there are strata.
+ * Strata without any sampled files are left out of the estimate, so it
+ * applies to the files in the sampled strata only.
+ */
+static void estimate(const struct sampler *s, int status, double *p,
+		double *low, double *high)
+{
+	long long population = 0, sampled = 0;
+	double var = 0.0, z = SAMPLE_Z;
+	bool complete = true;
+
+	*p = 0.0;
+	for (size_t i = 0; i < s->count; i++) {
+		const struct sample_stratum *st = &s->list[i];
+		if (st->sampled > 0)
+			population += st->population;
+	}
+	if (population == 0) {
+		*low = 0.0;
+		*high = 1.0;
+		return;
+	}
+
+	for (size_t i = 0; i < s->count; i++) {
+		const struct sample_stratum *st = &s->list[i];
+		if (st->sampled < 1)
+			continue;
+		double w = (double)st->population / population;
+		double ph = (double)st->counts[status] / st->sampled;
+		double fpc = 1.0 - (double)st->sampled / st->population;
+		*p += w * ph;
+		if (fpc > 0)
+			complete = false;
+		else
+			fpc = 0.0;
+		if (st->sampled > 1)
+			var += w * w * fpc * ph * (1.0 - ph) / (st->sampled - 1);
+		sampled += st->sampled;
+	}
+
+	if (complete) {
+		*low = *high = *p;
+		return;
+	}
+
+	double n = (var > 0 ? *p * (1.0 - *p) / var : (double)sampled);
+	double denom = 1.0 + z * z / n;
+	double center = (*p + z * z / (2 * n)) / denom;
+	double half = z * sqrt(*p * (1.0 - *p) / n + z * z / (4 * n * n)) / denom;
+
+	*low = (center - half > 0.0 ? center - half : 0.0);
+	*high = (center + half < 1.0 ? center + half : 1.0);
+}
+
+
+/* Print estimated rates and counts (extrapolated stratum by stratum to input files) */
+void sampler_report(struct sampler *s, FILE *out, bool verbose)
+{
+	long long population = 0, selected = 0, sampled = 0;
+	long long covered = 0, uncovered = 0;
+	size_t empty = 0;
+
+	if (!s || !out)
+		return;
+
+	for (size_t i = 0; i < s->count; i++) {
+		population += s->list[i].population;
+		selected += s->list[i].selected;
+		sampled += s->list[i].sampled;
+		if (s->list[i].sampled < 1) {
+			uncovered += s->list[i].population;
+			empty++;
+		} else {
+			covered += s->list[i].population;
+		}
+	}
+
+	fprintf(out, "jpeginfo: sampled %lld of %lld files (rate %g, seed %llu",
+		sampled, population, s->rate, s->seed);
+	if (s->strata != STRATA_NONE)
+		fprintf(out, ", %lu strata by %s", (unsigned long)s->count,
+			(s->strata == STRATA_DIR ? "directory" : "size"));
+	fprintf(out, ")\n");
+	if (selected > sampled)
+		fprintf(out, "jpeginfo: %lld selected files could not be read\n",
+			selected - sampled);
+	if (empty > 0 && sampled > 0)
+		fprintf(out, "jpeginfo: %lld files in %lu strata without sampled files are not "
+			"included in the estimates (estimates cover %lld files)\n",
+			uncovered, (unsigned long)empty, covered);
+	if (sampled == 0)
+		return;
+
+	for (int status = 2; status < SAMPLE_CLASSES; status++) {
+		long long count = 0;
+		double p, low, high;
+
+		for (size_t i = 0; i < s->count; i++)
+			count += s->list[i].counts[status];
+		estimate(s, status, &p, &low, &high);
+		fprintf(out, "jpeginfo: %-7s %lld in sample, estimated rate %.3f%% "
+			"(95%% CI %.3f%% - %.3f%%), ~%.0f files (%.0f - %.0f)\n",
+			check_status_str(status), count, p * 100, low * 100, high * 100,
+			p * covered, low * covered, high * covered);
+	}
+
+	if (!verbose || s->strata == STRATA_NONE)
+		return;
+	for (size_t i = 0; i < s->count; i++) {
+		const struct sample_stratum *st = &s->list[i];
+		fprintf(out, "jpeginfo:   %s: %lld files, %lld sampled%s", st->key,
+			st->population, st->sampled, (st->sampled < 1 ? " (not estimated)" : ""));
+		for (int status = 2; status < SAMPLE_CLASSES; status++) {
+			if (st->counts[status] > 0)
+				fprintf(out, ", %lld %s", st->counts[status],
+					check_status_str(status));
+		}
+		fprintf(out, "\n");
+	}
+}
+
+
+void sampler_free(struct sampler *s)
+{
+	if (!s)
+		return;
+
+	for (size_t i = 0; i < s->count; i++)
+		free(s->list[i].key);
+	free(s->list);
+	free(s->table);
+	memset(s, 0, sizeof(struct sampler));
+}
+
+/* eof :-) */
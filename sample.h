@@ -0,0 +1,52 @@
+/* sample.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H 1
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define SAMPLE_CLASSES 7   /* check status values (0 = not checked) */
+#define SAMPLE_Z       1.96 /* 95% confidence */
+
+enum sample_strata {
+	STRATA_NONE = 0,
+	STRATA_DIR,
+	STRATA_SIZE
+};
+
+struct sample_stratum {
+	char *key;
+	double phase;
+	long long population;
+	long long selected;
+	long long sampled;
+	long long counts[SAMPLE_CLASSES];
+};
+
+struct sampler {
+	double rate;
+	unsigned long long seed;
+	enum sample_strata strata;
+	struct sample_stratum *list;
+	size_t count;
+	size_t size;
+	size_t *table;
+	size_t table_size;
+};
+
+int parse_sample_rate(const char *arg, double *rate);
+int parse_sample_strata(const char *arg, enum sample_strata *strata);
+void sampler_init(struct sampler *s, double rate, unsigned long long seed,
+		enum sample_strata strata);
+bool sampler_select(struct sampler *s, const char *path);
+void sampler_result(struct sampler *s, const char *path, int status);
+void sampler_report(struct sampler *s, FILE *out, bool verbose);
+void sampler_free(struct sampler *s);
+
+
+#endif /* SAMPLE_H */
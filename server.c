@@ -0,0 +1,471 @@
+/* server.c - pre-forking socket server and connection helpers
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "jpeginfo.h"
+#include "server.h"
+
+
+int server_listen_unix(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if (!path || strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "jpeginfo: invalid socket path\n");
+		return -1;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fprintf(stderr, "jpeginfo: socket() failed: %s\n", strerror(errno));
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncopy(addr.sun_path, path, sizeof(addr.sun_path));
+
+	/* Remove stale socket left behind by previous instance (but nothing else) */
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "jpeginfo: cannot listen on '%s': %s\n", path,
+				strerror(EADDRINUSE));
+			close(fd);
+			return -1;
+		}
+		unlink(path);
+	}
+
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+		fprintf(stderr, "jpeginfo: cannot listen on '%s': %s\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+static bool is_loopback(const struct sockaddr *sa)
+{
+	if (sa->sa_family == AF_INET) {
+		const struct sockaddr_in *in = (const struct sockaddr_in*)sa;
+		return ((ntohl(in->sin_addr.s_addr) >> 24) == 127);
+	}
+	if (sa->sa_family == AF_INET6) {
+		const struct in6_addr *a = &((const struct sockaddr_in6*)sa)->sin6_addr;
+		return (IN6_IS_ADDR_LOOPBACK(a) || (IN6_IS_ADDR_V4MAPPED(a) && a->s6_addr[12] == 127));
+	}
+
+	return false;
+}
+
+
+/*
+ * Listen on TCP address given in "host:port" (or "[host]:port") format.
+ * Empty host means loopback, other than loopback addresses are refused
+ * unless allow_remote is set (there is no authentication).
+ */
+int server_listen_tcp(const char *address, bool allow_remote)
+{
+	struct addrinfo hints, *res;
+	char host[256];
+	const char *port;
+	int one = 1;
+
+	if (!address || !(port = strrchr(address, ':')) || port - address >= sizeof(host)) {
+		fprintf(stderr, "jpeginfo: invalid listen address (host:port expected)\n");
+		return -1;
+	}
+	if (address[0] == '[' && port > address + 1 && *(port - 1) == ']')
+		strncopy(host, address + 1, port - address - 1);
+	else
+		strncopy(host, address, port - address + 1);
+	port++;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	int r = getaddrinfo(host[0] ? host : "127.0.0.1", port, &hints, &res);
+	if (r != 0) {
+		fprintf(stderr, "jpeginfo: invalid listen address '%s': %s\n",
+			address, gai_strerror(r));
+		return -1;
+	}
+
+	if (!allow_remote && !is_loopback(res->ai_addr)) {
+		fprintf(stderr, "jpeginfo: refusing to listen on non-loopback address '%s' "
+			"(use --http-public to allow)\n", address);
+		freeaddrinfo(res);
+		return -1;
+	}
+
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd < 0) {
+		fprintf(stderr, "jpeginfo: socket() failed: %s\n", strerror(errno));
+		freeaddrinfo(res);
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 || listen(fd, 128) < 0) {
+		fprintf(stderr, "jpeginfo: cannot listen on '%s': %s\n", address, strerror(errno));
+		freeaddrinfo(res);
+		close(fd);
+		return -1;
+	}
+	freeaddrinfo(res);
+
+	return fd;
+}
+
+
+/* Set options for a (TCP) connection to favour latency */
+void server_tune_connection(int fd, int timeout)
+{
+	struct timeval tv = { timeout, 0 };
+	int one = 1;
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (timeout > 0)
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+
+int client_connect_unix(const char *path)
+{
+	struct sockaddr_un addr;
+
+	if (!path || strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncopy(addr.sun_path, path, sizeof(addr.sun_path));
+
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+static void worker_loop(int listen_fd, void (*handler)(int fd))
+{
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+
+	while (1) {
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			fprintf(stderr, "jpeginfo: accept() failed: %s\n", strerror(errno));
+			exit(2);
+		}
+		/* Processes forked by the handler must not keep connection open */
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		handler(fd);
+		close(fd);
+	}
+}
+
+
+static pid_t start_worker(int listen_fd, void (*handler)(int fd))
+{
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		worker_loop(listen_fd, handler);
+		exit(0);
+	}
+	if (pid < 0)
+		fprintf(stderr, "jpeginfo: fork() failed: %s\n", strerror(errno));
+
+	return pid;
+}
+
+
+/*
+ * Run server with a pool of pre-forked worker processes, each accepting
+ * and serving one connection at a time. Workers that die are restarted.
+ */
+int server_run(int listen_fd, int workers, void (*handler)(int fd),
+	volatile sig_atomic_t *stop)
+{
+	if (listen_fd < 0 || !handler)
+		return -1;
+	if (workers < 1)
+		workers = 1;
+
+	pid_t *pids = calloc(workers, sizeof(pid_t));
+	if (!pids)
+		no_memory();
+
+	signal(SIGPIPE, SIG_IGN);
+
+	for (int i = 0; i < workers; i++)
+		pids[i] = start_worker(listen_fd, handler);
+
+	while (!(stop && *stop)) {
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (int i = 0; i < workers; i++) {
+			if (pids[i] == pid) {
+				if (stop && *stop)
+					break;
+				fprintf(stderr, "jpeginfo: worker %d exited (status %d), restarting\n",
+					(int)pid, status);
+				pids[i] = start_worker(listen_fd, handler);
+				break;
+			}
+		}
+	}
+
+	for (int i = 0; i < workers; i++) {
+		if (pids[i] > 0)
+			kill(pids[i], SIGTERM);
+	}
+	while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+		;
+	free(pids);
+
+	return 0;
+}
+
+
+void conn_reader_init(struct conn_reader *c, int fd)
+{
+	if (!c)
+		return;
+
+	c->fd = fd;
+	c->start = c->end = 0;
+	c->nfds = 0;
+	c->eof = 0;
+}
+
+
+void conn_reader_close(struct conn_reader *c)
+{
+	if (!c)
+		return;
+
+	for (int i = 0; i < c->nfds; i++)
+		close(c->fds[i]);
+	c->nfds = 0;
+}
+
+
+/*
+ * Read next line (terminated by LF) from the connection. Any file descriptors
+ * received (SCM_RIGHTS) are queued and can be retrieved using conn_take_fd().
+ */
+char *conn_read_line(struct conn_reader *c)
+{
+	if (!c)
+		return NULL;
+
+	while (1) {
+		char *nl = memchr(c->buf + c->start, '\n', c->end - c->start);
+		if (nl) {
+			char *line = c->buf + c->start;
+			*nl = 0;
+			if (nl > line && *(nl - 1) == '\r')
+				*(nl - 1) = 0;
+			c->start = nl - c->buf + 1;
+			return line;
+		}
+		if (c->eof)
+			return NULL;
+
+		if (c->start > 0) {
+			memmove(c->buf, c->buf + c->start, c->end - c->start);
+			c->end -= c->start;
+			c->start = 0;
+		}
+		if (c->end >= sizeof(c->buf) - 1) {
+			/* Line too long */
+			c->eof = 1;
+			return NULL;
+		}
+
+		union {
+			struct cmsghdr hdr;
+			char buf[CMSG_SPACE(sizeof(int) * CONN_MAX_FDS)];
+		} cmsgbuf;
+		struct iovec iov = { c->buf + c->end, sizeof(c->buf) - 1 - c->end };
+		struct msghdr msg;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cmsgbuf.buf;
+		msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+		/* Received descriptors must not leak into processes forked later */
+#ifdef MSG_CMSG_CLOEXEC
+		ssize_t n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+#else
+		ssize_t n = recvmsg(c->fd, &msg, 0);
+#endif
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			c->eof = 1;
+			return NULL;
+		}
+		if (n == 0)
+			c->eof = 1;
+		c->end += n;
+
+		for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+				continue;
+			int count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			int *fds = (int*)CMSG_DATA(cm);
+			for (int i = 0; i < count; i++) {
+#ifndef MSG_CMSG_CLOEXEC
+				fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+#endif
+				if (c->nfds < CONN_MAX_FDS)
+					c->fds[c->nfds++] = fds[i];
+				else
+					close(fds[i]);
+			}
+		}
+	}
+}
+
+
+/* Return (oldest) file descriptor received from the connection, or -1 */
+int conn_take_fd(struct conn_reader *c)
+{
+	if (!c || c->nfds < 1)
+		return -1;
+
+	int fd = c->fds[0];
+	c->nfds--;
+	memmove(c->fds, c->fds + 1, c->nfds * sizeof(int));
+
+	return fd;
+}
+
+
+/* Send buffer and (optionally) pass a file descriptor along with it */
+int send_with_fd(int sock, const char *buf, size_t len, int fd)
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} cmsgbuf;
+	struct iovec iov = { (void*)buf, len };
+	struct msghdr msg;
+
+	if (fd < 0)
+		return write_all(sock, buf, len);
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&cmsgbuf, 0, sizeof(cmsgbuf));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf.buf;
+	msg.msg_controllen = sizeof(cmsgbuf.buf);
+
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+
+	ssize_t n;
+	do {
+		n = sendmsg(sock, &msg, 0);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0)
+		return -1;
+
+	/* Send rest of the buffer (if any) */
+	return (n < len ? write_all(sock, buf + n, len - n) : 0);
+}
+
+
+int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* eof :-) */
@@ -0,0 +1,42 @@
+/* server.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef SERVER_H
+#define SERVER_H 1
+
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define CONN_BUFFER_SIZE (64 * 1024)
+#define CONN_MAX_FDS     16
+
+struct conn_reader {
+	int fd;
+	char buf[CONN_BUFFER_SIZE];
+	size_t start;
+	size_t end;
+	int fds[CONN_MAX_FDS];
+	int nfds;
+	int eof;
+};
+
+int server_listen_unix(const char *path);
+int server_listen_tcp(const char *address, bool allow_remote);
+void server_tune_connection(int fd, int timeout);
+int server_run(int listen_fd, int workers, void (*handler)(int fd),
+	volatile sig_atomic_t *stop);
+int client_connect_unix(const char *path);
+
+void conn_reader_init(struct conn_reader *c, int fd);
+char *conn_read_line(struct conn_reader *c);
+int conn_take_fd(struct conn_reader *c);
+void conn_reader_close(struct conn_reader *c);
+int send_with_fd(int sock, const char *buf, size_t len, int fd);
+int write_all(int fd, const void *buf, size_t len);
+
+
+#endif /* SERVER_H */
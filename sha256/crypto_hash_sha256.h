@@ -8,11 +8,24 @@ extern std::string crypto_hash_sha256_ref(const std::string &);
 extern "C" {
 #endif
 extern int crypto_hash_sha256_ref(unsigned char *,const unsigned char *,unsigned long long);
+
+typedef struct crypto_hash_sha256_state {
+  unsigned char h[32];
+  unsigned char buf[64];
+  unsigned long long bytes;
+} crypto_hash_sha256_state;
+
+extern int crypto_hash_sha256_ref_init(crypto_hash_sha256_state *);
+extern int crypto_hash_sha256_ref_update(crypto_hash_sha256_state *,const unsigned char *,unsigned long long);
+extern int crypto_hash_sha256_ref_final(crypto_hash_sha256_state *,unsigned char *);
 #ifdef __cplusplus
 }
 #endif
 
 #define crypto_hash_sha256 crypto_hash_sha256_ref
+#define crypto_hash_sha256_init crypto_hash_sha256_ref_init
+#define crypto_hash_sha256_update crypto_hash_sha256_ref_update
+#define crypto_hash_sha256_final crypto_hash_sha256_ref_final
 #define crypto_hash_sha256_BYTES crypto_hash_sha256_ref_BYTES
 #define crypto_hash_sha256_IMPLEMENTATION "crypto_hash/sha256/ref"
 #ifndef crypto_hash_sha256_ref_VERSION
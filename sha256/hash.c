@@ -64,3 +64,74 @@ int crypto_hash_sha256(unsigned char *out,const unsigned char *in,unsigned long
 
   return 0;
 }
+
+int crypto_hash_sha256_init(crypto_hash_sha256_state *state)
+{
+  for (int i = 0;i < 32;++i) state->h[i] = iv[i];
+  state->bytes = 0;
+
+  return 0;
+}
+
+int crypto_hash_sha256_update(crypto_hash_sha256_state *state,const unsigned char *in,unsigned long long inlen)
+{
+  unsigned int used = state->bytes & 63;
+
+  state->bytes += inlen;
+
+  if (used > 0) {
+    while (inlen > 0 && used < 64) {
+      state->buf[used++] = *in++;
+      --inlen;
+    }
+    if (used < 64) return 0;
+    blocks(state->h,state->buf,64);
+  }
+
+  blocks(state->h,in,inlen);
+  in += inlen;
+  inlen &= 63;
+  in -= inlen;
+
+  for (int i = 0;i < inlen;++i) state->buf[i] = in[i];
+
+  return 0;
+}
+
+int crypto_hash_sha256_final(crypto_hash_sha256_state *state,unsigned char *out)
+{
+  const unsigned long long bits = state->bytes << 3;
+  const unsigned int inlen = state->bytes & 63;
+
+  unsigned char padded[128];
+  for (int i = 0;i < inlen;++i) padded[i] = state->buf[i];
+  padded[inlen] = 0x80;
+
+  if (inlen < 56) {
+    for (int i = inlen + 1;i < 56;++i) padded[i] = 0;
+    padded[56] = bits >> 56;
+    padded[57] = bits >> 48;
+    padded[58] = bits >> 40;
+    padded[59] = bits >> 32;
+    padded[60] = bits >> 24;
+    padded[61] = bits >> 16;
+    padded[62] = bits >> 8;
+    padded[63] = bits;
+    blocks(state->h,padded,64);
+  } else {
+    for (int i = inlen + 1;i < 120;++i) padded[i] = 0;
+    padded[120] = bits >> 56;
+    padded[121] = bits >> 48;
+    padded[122] = bits >> 40;
+    padded[123] = bits >> 32;
+    padded[124] = bits >> 24;
+    padded[125] = bits >> 16;
+    padded[126] = bits >> 8;
+    padded[127] = bits;
+    blocks(state->h,padded,128);
+  }
+
+  for (int i = 0;i < 32;++i) out[i] = state->h[i];
+
+  return 0;
+}
@@ -8,11 +8,24 @@ extern std::string crypto_hash_sha512_ref(const std::string &);
 extern "C" {
 #endif
 extern int crypto_hash_sha512_ref(unsigned char *,const unsigned char *,unsigned long long);
+
+typedef struct crypto_hash_sha512_state {
+  unsigned char h[64];
+  unsigned char buf[128];
+  unsigned long long bytes;
+} crypto_hash_sha512_state;
+
+extern int crypto_hash_sha512_ref_init(crypto_hash_sha512_state *);
+extern int crypto_hash_sha512_ref_update(crypto_hash_sha512_state *,const unsigned char *,unsigned long long);
+extern int crypto_hash_sha512_ref_final(crypto_hash_sha512_state *,unsigned char *);
 #ifdef __cplusplus
 }
 #endif
 
 #define crypto_hash_sha512 crypto_hash_sha512_ref
+#define crypto_hash_sha512_init crypto_hash_sha512_ref_init
+#define crypto_hash_sha512_update crypto_hash_sha512_ref_update
+#define crypto_hash_sha512_final crypto_hash_sha512_ref_final
 #define crypto_hash_sha512_BYTES crypto_hash_sha512_ref_BYTES
 #define crypto_hash_sha512_IMPLEMENTATION "crypto_hash/sha512/ref"
 #ifndef crypto_hash_sha512_ref_VERSION
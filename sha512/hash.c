@@ -66,3 +66,76 @@ int crypto_hash_sha512(unsigned char *out,const unsigned char *in,unsigned long
 
   return 0;
 }
+
+int crypto_hash_sha512_init(crypto_hash_sha512_state *state)
+{
+  for (int i = 0;i < 64;++i) state->h[i] = iv[i];
+  state->bytes = 0;
+
+  return 0;
+}
+
+int crypto_hash_sha512_update(crypto_hash_sha512_state *state,const unsigned char *in,unsigned long long inlen)
+{
+  unsigned int used = state->bytes & 127;
+
+  state->bytes += inlen;
+
+  if (used > 0) {
+    while (inlen > 0 && used < 128) {
+      state->buf[used++] = *in++;
+      --inlen;
+    }
+    if (used < 128) return 0;
+    blocks(state->h,state->buf,128);
+  }
+
+  blocks(state->h,in,inlen);
+  in += inlen;
+  inlen &= 127;
+  in -= inlen;
+
+  for (int i = 0;i < inlen;++i) state->buf[i] = in[i];
+
+  return 0;
+}
+
+int crypto_hash_sha512_final(crypto_hash_sha512_state *state,unsigned char *out)
+{
+  const unsigned long long bytes = state->bytes;
+  const unsigned int inlen = bytes & 127;
+  unsigned char padded[256];
+
+  for (int i = 0;i < inlen;++i) padded[i] = state->buf[i];
+  padded[inlen] = 0x80;
+
+  if (inlen < 112) {
+    for (int i = inlen + 1;i < 119;++i) padded[i] = 0;
+    padded[119] = bytes >> 61;
+    padded[120] = bytes >> 53;
+    padded[121] = bytes >> 45;
+    padded[122] = bytes >> 37;
+    padded[123] = bytes >> 29;
+    padded[124] = bytes >> 21;
+    padded[125] = bytes >> 13;
+    padded[126] = bytes >> 5;
+    padded[127] = bytes << 3;
+    blocks(state->h,padded,128);
+  } else {
+    for (int i = inlen + 1;i < 247;++i) padded[i] = 0;
+    padded[247] = bytes >> 61;
+    padded[248] = bytes >> 53;
+    padded[249] = bytes >> 45;
+    padded[250] = bytes >> 37;
+    padded[251] = bytes >> 29;
+    padded[252] = bytes >> 21;
+    padded[253] = bytes >> 13;
+    padded[254] = bytes >> 5;
+    padded[255] = bytes << 3;
+    blocks(state->h,padded,256);
+  }
+
+  for (int i = 0;i < 64;++i) out[i] = state->h[i];
+
+  return 0;
+}
@@ -0,0 +1,176 @@
+/* shard.c - split input between multiple (independent) jpeginfo runs
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "jpeginfo.h"
+#include "shard.h"
+
+
+/*
+ * Shard assignment must only depend on the input (paths and file sizes),
+ * so that separate runs (on different machines) with the same input list
+ * agree on which files belong to which shard.
+ */
+
+
+/* Parse shard specification "i/N" (1 <= i <= N) */
+int parse_shard(const char *arg, int *index, int *count)
+{
+	char *end;
+
+	if (!arg || !index || !count)
+		return -1;
+
+	long i = strtol(arg, &end, 10);
+	if (end == arg || *end != '/')
+		return -1;
+	const char *p = end + 1;
+	long n = strtol(p, &end, 10);
+	if (end == p || *end || n < 1 || n > SHARD_MAX || i < 1 || i > n)
+		return -1;
+
+	*index = i - 1;
+	*count = n;
+
+	return 0;
+}
+
+
+/* FNV-1a (64bit) hash */
+static uint64_t fnv1a(const char *s)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+
+/* Check if file belongs to given shard (based on hash of the path) */
+bool shard_match(const char *path, int index, int count)
+{
+	if (!path || count < 2)
+		return true;
+
+	return (fnv1a(path) % count) == index;
+}
+
+
+struct shard_file {
+	const char *path;
+	long long size;
+	size_t pos;
+};
+
+
+static int cmp_size(const void *a, const void *b)
+{
+	const struct shard_file *fa = a, *fb = b;
+
+	if (fa->size != fb->size)
+		return (fa->size > fb->size ? -1 : 1);
+	int r = strcmp(fa->path, fb->path);
+	if (r)
+		return r;
+
+	return (fa->pos < fb->pos ? -1 : 1);
+}
+
+
+static int cmp_pos(const void *a, const void *b)
+{
+	const struct shard_file *fa = a, *fb = b;
+
+	return (fa->pos < fb->pos ? -1 : (fa->pos > fb->pos ? 1 : 0));
+}
+
+
+/*
+ * Select files for given shard so that each shard gets roughly the same
+ * number of bytes: files are assigned largest first, each to the shard with
+ * the least bytes so far. Selected paths are stored (in original order)
+ * into beginning of paths array, followed by the rest of the paths (so that
+ * caller can free them), and number of selected paths is returned.
+ */
+size_t shard_balance(const char **paths, size_t n, int index, int count)
+{
+	struct shard_file *files;
+	long long *total;
+	struct stat st;
+	size_t selected = 0, dropped = 0;
+
+	if (!paths || count < 2)
+		return n;
+
+	files = malloc(sizeof(struct shard_file) * (n > 0 ? n : 1));
+	total = calloc(count, sizeof(long long));
+	if (!files || !total)
+		no_memory();
+
+	for (size_t i = 0; i < n; i++) {
+		files[i].path = paths[i];
+		files[i].size = (stat(paths[i], &st) == 0 ? st.st_size : 0);
+		files[i].pos = i;
+	}
+	qsort(files, n, sizeof(struct shard_file), cmp_size);
+
+	for (size_t i = 0; i < n; i++) {
+		int s = 0;
+		for (int j = 1; j < count; j++) {
+			if (total[j] < total[s])
+				s = j;
+		}
+		total[s] += files[i].size;
+		if (s == index)
+			files[selected++] = files[i];
+		else
+			paths[n - ++dropped] = files[i].path;
+	}
+
+	qsort(files, selected, sizeof(struct shard_file), cmp_pos);
+	for (size_t i = 0; i < selected; i++)
+		paths[i] = files[i].path;
+
+	free(total);
+	free(files);
+
+	return selected;
+}
+
+/* eof :-) */
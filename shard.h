@@ -0,0 +1,19 @@
+/* shard.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef SHARD_H
+#define SHARD_H 1
+
+#include <stdbool.h>
+
+#define SHARD_MAX 100000
+
+int parse_shard(const char *arg, int *index, int *count);
+bool shard_match(const char *path, int index, int count);
+size_t shard_balance(const char **paths, size_t n, int index, int count);
+
+
+#endif /* SHARD_H */
@@ -0,0 +1,209 @@
+/* sink.c - output sinks with buffering writer processes
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "jpeginfo.h"
+#include "server.h"
+#include "sink.h"
+
+
+/*
+ * Output written into a file is passed through a pipe (with a large
+ * buffer) to a writer process, so that a slow output file (network
+ * filesystem, full disk cache, etc.) does not stall the decoding.
+ * Standard output ("-") is written directly. Writers ignore terminal
+ * signals and finish when the pipe is closed, so that all output written
+ * before an interrupt still ends up in the file. Main process ignores
+ * SIGPIPE while sinks are open (a failed writer is reported on close).
+ */
+
+#define MAX_SINKS 64
+
+static int sink_fds[MAX_SINKS];
+static int sink_fd_count = 0;
+static void (*saved_sigpipe)(int) = SIG_DFL;
+
+
+static void writer_loop(int in, int out)
+{
+	char *buf = malloc(SINK_BUFFER_SIZE);
+	ssize_t n;
+
+	if (!buf)
+		_exit(2);
+
+	while ((n = read(in, buf, SINK_BUFFER_SIZE)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			_exit(2);
+		}
+		if (write_all(out, buf, n) < 0) {
+			fprintf(stderr, "jpeginfo: write failed: %s\n", strerror(errno));
+			_exit(2);
+		}
+	}
+	if (close(out) < 0)
+		_exit(2);
+	_exit(0);
+}
+
+
+int sink_open(struct sink *s, const char *path)
+{
+	int pfd[2];
+
+	if (!s || !path)
+		return -1;
+
+	memset(s, 0, sizeof(struct sink));
+	s->fd = -1;
+
+	if (!strcmp(path, "-")) {
+		s->fp = stdout;
+		return 0;
+	}
+
+	if (sink_fd_count >= MAX_SINKS) {
+		fprintf(stderr, "jpeginfo: too many outputs\n");
+		return -1;
+	}
+
+	int out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (out < 0) {
+		fprintf(stderr, "jpeginfo: cannot create '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (pipe(pfd) < 0) {
+		fprintf(stderr, "jpeginfo: pipe() failed: %s\n", strerror(errno));
+		close(out);
+		return -1;
+	}
+#ifdef F_SETPIPE_SZ
+	fcntl(pfd[1], F_SETPIPE_SZ, SINK_PIPE_SIZE);
+#endif
+
+	fflush(NULL);
+	pid_t pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "jpeginfo: fork() failed: %s\n", strerror(errno));
+		close(out);
+		close(pfd[0]);
+		close(pfd[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		/* Writer must not hold write end of any pipe open (or it never sees EOF) */
+		close(pfd[1]);
+		sink_close_fds();
+		signal(SIGINT, SIG_IGN);
+		signal(SIGTERM, SIG_IGN);
+		signal(SIGHUP, SIG_IGN);
+		writer_loop(pfd[0], out);
+	}
+
+	close(out);
+	close(pfd[0]);
+	if (!(s->fp = fdopen(pfd[1], "w"))) {
+		close(pfd[1]);
+		return -1;
+	}
+	setvbuf(s->fp, NULL, _IOFBF, SINK_BUFFER_SIZE);
+	s->writer = pid;
+	s->fd = pfd[1];
+	if (sink_fd_count == 0)
+		saved_sigpipe = signal(SIGPIPE, SIG_IGN);
+	sink_fds[sink_fd_count++] = pfd[1];
+
+	return 0;
+}
+
+
+/* Close sink and wait for its writer to finish, returns -1 (and sets errno) on errors */
+int sink_close(struct sink *s)
+{
+	int r = 0, err = 0, status;
+
+	if (!s || !s->fp)
+		return -1;
+
+	if (s->fp == stdout) {
+		r = (fflush(stdout) == EOF ? -1 : 0);
+		s->fp = NULL;
+		return r;
+	}
+
+	if (fclose(s->fp) == EOF) {
+		/* EPIPE if writer has exited before reading everything */
+		err = errno;
+		r = -1;
+	}
+	s->fp = NULL;
+	for (int i = 0; i < sink_fd_count; i++) {
+		if (sink_fds[i] == s->fd) {
+			sink_fds[i] = sink_fds[--sink_fd_count];
+			break;
+		}
+	}
+	if (sink_fd_count == 0)
+		signal(SIGPIPE, saved_sigpipe);
+	while (waitpid(s->writer, &status, 0) < 0) {
+		if (errno != EINTR) {
+			err = (err ? err : errno);
+			r = -1;
+			break;
+		}
+	}
+	if (r == 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+		err = EIO;
+		r = -1;
+	}
+
+	errno = err;
+	return r;
+}
+
+
+/* Close write ends of all sinks (in a forked child process) */
+void sink_close_fds(void)
+{
+	for (int i = 0; i < sink_fd_count; i++)
+		close(sink_fds[i]);
+}
+
+/* eof :-) */
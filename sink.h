@@ -0,0 +1,27 @@
+/* sink.h
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ *
+ */
+
+#ifndef SINK_H
+#define SINK_H 1
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#define SINK_PIPE_SIZE   (1024 * 1024)
+#define SINK_BUFFER_SIZE (256 * 1024)
+
+struct sink {
+	FILE *fp;
+	pid_t writer;
+	int fd;
+};
+
+int sink_open(struct sink *s, const char *path);
+int sink_close(struct sink *s);
+void sink_close_fds(void);
+
+
+#endif /* SINK_H */
@@ -20,11 +20,75 @@
 
 """jpeginfo unit tester"""
 
+import http.client
 import json
+import os
+import re
+import shutil
+import signal
+import socket
+import struct
 import subprocess
+import tempfile
+import time
 import unittest
 
 
+def read_arrow_stream(data):
+    """decode (minimal) Arrow IPC stream into a dictionary of columns"""
+    def num(fmt, pos):
+        return struct.unpack_from('<' + fmt, data, pos)[0]
+    def ref(pos):
+        return pos + num('I', pos)
+    def field(table, index):
+        vtable = table - num('i', table)
+        if 4 + 2 * index >= num('H', vtable) or not num('H', vtable + 4 + 2 * index):
+            return None
+        return table + num('H', vtable + 4 + 2 * index)
+    def string(pos):
+        pos = ref(pos)
+        return data[pos + 4:pos + 4 + num('I', pos)].decode()
+
+    schema, columns, pos = [], {}, 0
+    while num('i', pos + 4) > 0:
+        assert num('I', pos) == 0xffffffff
+        body = pos + 8 + num('i', pos + 4)
+        message = ref(pos + 8)
+        header = ref(field(message, 2))
+        if data[field(message, 1)] == 1:
+            # Schema: (name, type, bit width) of each field
+            fields = ref(field(header, 1))
+            for i in range(num('I', fields)):
+                table = ref(fields + 4 + 4 * i)
+                kind = data[field(table, 2)]
+                width = num('i', field(ref(field(table, 3)), 0)) if kind == 2 else 0
+                schema.append((string(field(table, 0)), kind, width))
+                columns[schema[-1][0]] = []
+        else:
+            # RecordBatch: no nulls, so validity buffers are skipped
+            rows = num('q', field(header, 0))
+            buffers = ref(field(header, 2)) + 4
+            buffers = [(body + num('q', buffers + 16 * i), num('q', buffers + 16 * i + 8))
+                       for i in range(num('I', buffers - 4))]
+            for name, kind, width in schema:
+                buffers.pop(0)
+                start, _ = buffers.pop(0)
+                if kind == 2:
+                    values = struct.unpack_from(f'<{rows}{"i" if width == 32 else "q"}',
+                                                data, start)
+                elif kind == 6:
+                    values = [bool(data[start + i // 8] & (1 << (i % 8))) for i in range(rows)]
+                else:
+                    offsets = struct.unpack_from(f'<{rows + 1}i', data, start)
+                    start, _ = buffers.pop(0)
+                    values = [data[start + offsets[i]:start + offsets[i + 1]].decode()
+                              for i in range(rows)]
+                columns[name].extend(values)
+        body_len = field(message, 3)
+        pos = body + (num('q', body_len) if body_len else 0)
+    return columns
+
+
 class JpeginfoTests(unittest.TestCase):
     """jpeginfo test cases"""
 
@@ -113,6 +177,512 @@ class JpeginfoTests(unittest.TestCase):
         self.assertIn('4d5dc047caf3cbd84eec91dce3c14e938d8d3f730b152eefb72c8c3ebfa65e91'
                       '46bd304b15e009df6f74e7397435a10f375c5453a60e32c9aca738051c36e211', output)
 
+    def test_stream_mode(self):
+        """test streaming input from stdin through fixed size buffer"""
+        with open('jpeginfo_test1.jpg', 'rb') as f:
+            res = subprocess.run([self.program, '--stream', '--sha256', '-c', '-'],
+                                 stdin=f, stdout=subprocess.PIPE, check=True)
+        output = res.stdout.decode('utf-8')
+        self.assertIn('320159 9a36209da080e187a2f749ec4ed0db3e73bcebc689ca060d929bdc7d1384edac', output)
+        self.assertRegex(output, r'\sOK\s*$')
+
+    def test_frames_mode(self):
+        """test checking concatenated JPEG images (MJPEG stream)"""
+        data = b''
+        for name in ['jpeginfo_test2.jpg', 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']:
+            with open(name, 'rb') as f:
+                data += f.read()
+        res = subprocess.run([self.program, '--frames', '-c', '--json', '-'], input=data,
+                             stdout=subprocess.PIPE, stderr=subprocess.PIPE, check=False)
+        result = json.loads(res.stdout.decode('utf-8'))
+        self.assertEqual([0, 12851, 14899], [r['offset'] for r in result])
+        self.assertEqual(['OK', 'WARNING', 'OK'], [r['status'] for r in result])
+        self.assertIn('3 frames (0 corrupt, 1 with warnings)', res.stderr.decode('utf-8'))
+
+    def test_framed_mode(self):
+        """test length-prefixed batch input"""
+        data = b''
+        for name in ['jpeginfo_test2.jpg', 'jpeginfo_test2_broken.jpg']:
+            with open(name, 'rb') as f:
+                image = f.read()
+            data += struct.pack('>II', len(name), len(image)) + name.encode('utf-8') + image
+        res = subprocess.run([self.program, '--framed', '-c', '--csv'], input=data,
+                             stdout=subprocess.PIPE, check=False)
+        lines = res.stdout.decode('utf-8').splitlines()
+        self.assertEqual(2, len(lines))
+        self.assertTrue(lines[0].startswith('"jpeginfo_test2.jpg",12851,'))
+        self.assertTrue(lines[0].endswith('"OK",""'))
+        self.assertTrue(lines[1].startswith('"jpeginfo_test2_broken.jpg",2048,'))
+        self.assertIn('"WARNING"', lines[1])
+
+    def test_daemon_mode(self):
+        """test daemon and client modes"""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            sock = os.path.join(tmpdir, 'jpeginfo.sock')
+            with subprocess.Popen([self.program, '--daemon', sock, '--workers', '2']) as proc:
+                for _ in range(50):
+                    if os.path.exists(sock):
+                        break
+                    time.sleep(0.1)
+                args = ['-c', '--json', '--md5', 'jpeginfo_test2.jpg', 'jpeginfo_test2_broken.jpg']
+                output, res = self.run_test(['--client', sock] + args, check=False)
+                expected, expected_res = self.run_test(args, check=False)
+                proc.send_signal(signal.SIGTERM)
+                proc.wait(timeout=5)
+            # header only request followed by full checks on the same worker
+            with subprocess.Popen([self.program, '--daemon', sock, '--workers', '1']) as proc:
+                for _ in range(50):
+                    if os.path.exists(sock):
+                        break
+                    time.sleep(0.1)
+                results = []
+                for args in [['--json'], ['-c', '--json'], ['-c', '--json', '--md5']]:
+                    args.append('jpeginfo_test2.jpg')
+                    results.append((self.run_test(['--client', sock] + args, check=False),
+                                    self.run_test(args, check=False)))
+                proc.send_signal(signal.SIGTERM)
+                proc.wait(timeout=5)
+            for (mixed, mixed_res), (single, single_res) in results:
+                self.assertEqual(single_res, mixed_res)
+                self.assertEqual(json.loads(single), json.loads(mixed))
+            # existing file (that is not a socket) must not be removed
+            with open(sock, 'w') as f:
+                f.write('data')
+            error, error_res = self.run_test(['--daemon', sock], check=False)
+            self.assertEqual(2, error_res)
+            self.assertIn('in use', error)
+            with open(sock) as f:
+                self.assertEqual('data', f.read())
+        self.assertEqual(expected_res, res)
+        self.assertEqual(json.loads(expected), json.loads(output))
+
+    def test_http_mode(self):
+        """test HTTP server mode"""
+        with socket.socket() as s:
+            s.bind(('127.0.0.1', 0))
+            port = s.getsockname()[1]
+        with subprocess.Popen([self.program, '--http', f'127.0.0.1:{port}',
+                               '--workers', '2']) as proc:
+            try:
+                for _ in range(50):
+                    try:
+                        conn = http.client.HTTPConnection('127.0.0.1', port, timeout=5)
+                        conn.connect()
+                        break
+                    except ConnectionRefusedError:
+                        time.sleep(0.1)
+                results = []
+                # both requests use the same (keep-alive) connection
+                for name in ['jpeginfo_test2.jpg', 'jpeginfo_test2_broken.jpg']:
+                    with open(name, 'rb') as f:
+                        conn.request('POST', f'/check?check=1&hash=md5&name={name}', f.read())
+                    resp = conn.getresponse()
+                    self.assertEqual(200, resp.status)
+                    results.append(json.loads(resp.read()))
+                conn.request('GET', '/check')
+                resp = conn.getresponse()
+                resp.read()
+                self.assertEqual(405, resp.status)
+                conn.close()
+            finally:
+                proc.send_signal(signal.SIGTERM)
+                proc.wait(timeout=5)
+        expected, _ = self.run_test(['-c', '--json', '--md5', 'jpeginfo_test2.jpg',
+                                     'jpeginfo_test2_broken.jpg'], check=False)
+        self.assertEqual(json.loads(expected), results)
+        # non-loopback address requires --http-public
+        output, res = self.run_test(['--http', f'0.0.0.0:{port}'], check=False)
+        self.assertEqual(2, res)
+        self.assertIn('non-loopback', output)
+
+    def test_http_incremental(self):
+        """test HTTP mode analyzing upload as it arrives"""
+        with socket.socket() as s:
+            s.bind(('127.0.0.1', 0))
+            port = s.getsockname()[1]
+        with subprocess.Popen([self.program, '--http', f'127.0.0.1:{port}',
+                               '--workers', '1']) as proc:
+            try:
+                for _ in range(50):
+                    try:
+                        sock = socket.create_connection(('127.0.0.1', port), timeout=5)
+                        break
+                    except ConnectionRefusedError:
+                        time.sleep(0.1)
+                with open('jpeginfo_test1.jpg', 'rb') as f:
+                    data = f.read()
+                # send only part of the body, verdict should arrive without rest of it
+                sock.sendall(b'POST /check?check=1&max_pixels=1000000 HTTP/1.1\r\n'
+                             + f'Content-Length: {len(data)}\r\n\r\n'.encode()
+                             + data[:32768])
+                response = b''
+                while b'\n}' not in response and b'}\n' not in response:
+                    chunk = sock.recv(65536)
+                    if not chunk:
+                        break
+                    response += chunk
+                sock.close()
+            finally:
+                proc.send_signal(signal.SIGTERM)
+                proc.wait(timeout=5)
+        head, body = response.split(b'\r\n\r\n', 1)
+        self.assertTrue(head.startswith(b'HTTP/1.1 413 '))
+        result = json.loads(body)
+        self.assertEqual(2100, result['width'])
+        self.assertEqual('ERROR', result['status'])
+
+    def test_workers_mode(self):
+        """test processing files using worker processes"""
+        args = ['-c', '--json', '--md5', 'jpeginfo_test1.jpg', 'jpeginfo_test2.jpg',
+                'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        expected, expected_res = self.run_test(args, check=False)
+        output, res = self.run_test(['--workers', '3'] + args, check=False)
+        self.assertEqual(expected_res, res)
+        self.assertEqual(expected, output)
+
+    def test_workers_crash(self):
+        """test worker crashing while processing a file"""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            fifo = os.path.join(tmpdir, 'stuck.jpg')
+            os.mkfifo(fifo)
+            with subprocess.Popen([self.program, '-c', '--workers', '1', fifo,
+                                   'jpeginfo_test2.jpg'],
+                                  stdout=subprocess.PIPE, stderr=subprocess.DEVNULL) as proc:
+                # kill worker (stuck reading the fifo)
+                time.sleep(0.5)
+                for pid in [d for d in os.listdir('/proc') if d.isdigit()]:
+                    try:
+                        with open(f'/proc/{pid}/stat') as f:
+                            ppid = f.read().rsplit(')', 1)[1].split()[1]
+                    except OSError:
+                        continue
+                    if ppid == str(proc.pid):
+                        os.kill(int(pid), signal.SIGKILL)
+                output = proc.communicate(timeout=5)[0].decode()
+        lines = output.splitlines()
+        self.assertEqual(1, proc.returncode)
+        self.assertEqual(2, len(lines))
+        self.assertIn('CRASH', lines[0])
+        self.assertIn('OK', lines[1])
+
+    def test_shard(self):
+        """test splitting input files into shards"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg',
+                 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        for method in ['hash', 'size']:
+            names = []
+            for i in range(1, 4):
+                output, _ = self.run_test([f'--shard={i}/3', f'--shard-by={method}'] + files,
+                                          check=False)
+                names += [line.split()[0] for line in output.splitlines()]
+            self.assertEqual(sorted(files), sorted(names))
+
+    def test_queue_mode(self):
+        """test processing files from a shared work queue"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg',
+                 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        with tempfile.TemporaryDirectory() as tmpdir:
+            self.run_test(['--queue', tmpdir, '--queue-add', '--batch-size', '1'] + files)
+            self.assertEqual(4, len(os.listdir(os.path.join(tmpdir, 'todo'))))
+            # simulate batch claimed by an instance that has died
+            batch = sorted(os.listdir(os.path.join(tmpdir, 'todo')))[0]
+            claimed = os.path.join(tmpdir, 'claimed', batch + '@deadhost.1')
+            os.rename(os.path.join(tmpdir, 'todo', batch), claimed)
+            os.utime(claimed, (time.time() - 3600, time.time() - 3600))
+            procs = [subprocess.Popen([self.program, '-c', '--json', '--queue', tmpdir,
+                                       '--lease', '60'], stdout=subprocess.DEVNULL,
+                                      stderr=subprocess.DEVNULL) for _ in range(2)]
+            for proc in procs:
+                proc.wait(timeout=10)
+            names = []
+            for name in os.listdir(os.path.join(tmpdir, 'results')):
+                with open(os.path.join(tmpdir, 'results', name)) as f:
+                    names += [r['filename'] for r in json.load(f)]
+            self.assertEqual(4, len(os.listdir(os.path.join(tmpdir, 'done'))))
+            self.assertEqual([], os.listdir(os.path.join(tmpdir, 'claimed')))
+        self.assertEqual(sorted(files), sorted(names))
+
+    def test_null_list(self):
+        """test reading NUL separated lists of files"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg', 'jpeginfo_test3.jpg']
+        with tempfile.TemporaryDirectory() as tmpdir:
+            lists = [os.path.join(tmpdir, 'list1'), os.path.join(tmpdir, 'list2')]
+            with open(lists[0], 'w') as f:
+                f.write('\0'.join(files[:2]) + '\0')
+            with open(lists[1], 'w') as f:
+                f.write(files[2])
+            output, _ = self.run_test(['-0', '--csv', '-f', lists[0], '-f', lists[1]])
+        self.assertEqual(files, [line.split(',')[0].strip('"')
+                                 for line in output.splitlines()])
+
+    def test_sample(self):
+        """test checking a random sample of files"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg',
+                 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg'] * 25
+        args = ['--csv', '--sample=30%', '--seed=5'] + files
+        output, _ = self.run_test(args, check=False)
+        self.assertEqual(output, self.run_test(args, check=False)[0])
+        records = [l for l in output.splitlines() if not l.startswith('jpeginfo:')]
+        self.assertLess(len(records), len(files))
+        self.assertRegex(output, r'sampled \d+ of 100 files')
+        self.assertRegex(output, r'WARNING +\d+ in sample, estimated rate .*95% CI')
+        output, _ = self.run_test(['--csv', '--sample=1/4', '--sample-by=size'] + files,
+                                  check=False)
+        # each of the 4 strata (25 files) is sampled evenly
+        self.assertRegex(output, r'sampled 2[4-8] of 100 files .*4 strata')
+
+    def test_tiered(self):
+        """test listing headers first and checking files afterwards"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        output, res = self.run_test(['--json', '--tiered'] + files, check=False)
+        records = json.loads(output)
+        self.assertEqual(files * 2, [r['filename'] for r in records])
+        self.assertEqual(['', '', '', 'OK', 'WARNING', 'OK'],
+                         [r['status'] for r in records])
+        self.assertEqual(records[0]['width'], records[3]['width'])
+        self.assertEqual(1, res)
+
+    def test_limits(self):
+        """test per file limits and run deadline"""
+        output, res = self.run_test(['--json', '-c', '--max-scans=3', 'jpeginfo_test1.jpg',
+                                     'jpeginfo_test2.jpg'], check=False)
+        records = json.loads(output)
+        self.assertEqual(['LIMIT', 'OK'], [r['status'] for r in records])
+        self.assertEqual(1, res)
+        output, _ = self.run_test(['--json', '-c', '--file-timeout=1', 'jpeginfo_test1.jpg'],
+                                  check=False)
+        self.assertIn(json.loads(output)[0]['status'], ['TIMEOUT', 'OK'])
+        res = subprocess.run([self.program, '--json', '-c', '--deadline=0.001']
+                             + ['jpeginfo_test1.jpg'] * 50, encoding='utf-8',
+                             stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, check=False)
+        self.assertLess(len(json.loads(res.stdout)), 50)
+        self.assertNotIn('TIMEOUT', res.stdout)
+        # file cut off by the deadline is checked when resuming
+        args = ['--json', '-c'] + ['jpeginfo_test1.jpg'] * 20
+        expected, _ = self.run_test(args)
+        with tempfile.TemporaryDirectory() as tmpdir:
+            checkpoint = os.path.join(tmpdir, 'checkpoint')
+            outfile = os.path.join(tmpdir, 'output.json')
+            for deadline in (['--deadline=0.05'], []):
+                with open(outfile, 'a') as f:
+                    subprocess.run([self.program, '--checkpoint', checkpoint] + deadline + args,
+                                   stdout=f, stderr=subprocess.DEVNULL, check=False)
+            with open(outfile) as f:
+                self.assertEqual(expected, f.read())
+
+    def test_memory_limits(self):
+        """test image size and memory limits"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg']
+        for args in (['--max-pixels=100000'], ['--max-memory=8'],
+                     ['--max-memory=8', '--workers=2']):
+            output, res = self.run_test(['--json', '-c'] + args + files, check=False)
+            self.assertEqual(['LIMIT', 'OK'], [r['status'] for r in json.loads(output)])
+            self.assertEqual(1, res)
+        output, res = self.run_test(['--json', '-c', '--max-memory=64'] + files)
+        self.assertEqual(['OK', 'OK'], [r['status'] for r in json.loads(output)])
+
+    def test_huge_pages(self):
+        """test decoding with buffers using huge pages"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg'] * 2
+        expected, res = self.run_test(['-c'] + files, check=False)
+        output, res2 = self.run_test(['-c', '--huge-pages'] + files, check=False)
+        self.assertEqual(expected, output)
+        self.assertEqual(res, res2)
+
+    def test_stats(self):
+        """test that memory is reused between files"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        counts = []
+        for n in (1, 20):
+            output, _ = self.run_test(['-c', '-C', '-5', '--stats'] + files * n, check=False)
+            m = re.search(r'stats: (\d+) records, heap allocations: (\d+) record, '
+                          r'(\d+) decoder, (\d+) line buffer', output)
+            self.assertEqual(3 * n, int(m.group(1)))
+            counts.append([int(x) for x in m.groups()[1:]])
+        self.assertEqual(counts[0], counts[1])
+
+    def test_escaping(self):
+        """test escaping of special characters in JSON and CSV output"""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            name = os.path.join(tmpdir, 'a"b\\c\td\x01e\n.jpg')
+            shutil.copy('jpeginfo_test1.jpg', name)
+            output, _ = self.run_test(['--json', name])
+            self.assertEqual(name, json.loads(output)[0]['filename'])
+            self.assertIn('\\u0001', output)
+            output, _ = self.run_test(['--csv', name])
+            self.assertIn('"' + name.replace('"', '""') + '",', output)
+
+    def test_ndjson(self):
+        """test newline delimited JSON output"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        expected, _ = self.run_test(['-c', '--json'] + files, check=False)
+        output, _ = self.run_test(['-c', '--ndjson'] + files, check=False)
+        lines = output.splitlines()
+        self.assertEqual(len(files), len(lines))
+        self.assertEqual(json.loads(expected), [json.loads(l) for l in lines])
+        # records are passed on while program waits for more input filenames
+        with subprocess.Popen([self.program, '-c', '--ndjson', '-f', '-'],
+                              stdin=subprocess.PIPE, stdout=subprocess.PIPE) as proc:
+            proc.stdin.write(b'jpeginfo_test1.jpg\n')
+            proc.stdin.flush()
+            self.assertEqual('jpeginfo_test1.jpg', json.loads(proc.stdout.readline())['filename'])
+            proc.stdin.close()
+            self.assertEqual(b'', proc.stdout.read())
+
+    def test_format(self):
+        """test user defined output format"""
+        output, _ = self.run_test(['-c', '--format=%f\\t%w\\t%h\\t%H{md5}\\t%{status}\\t%e{json}\\n',
+                                   'jpeginfo_test1.jpg', 'jpeginfo_test2_broken.jpg'], check=False)
+        expected, _ = self.run_test(['-c', '--md5', '--json',
+                                     'jpeginfo_test1.jpg', 'jpeginfo_test2_broken.jpg'], check=False)
+        lines = [l.split('\t') for l in output.splitlines()]
+        self.assertEqual([[r['filename'], str(r['width']), str(r['height']), r['hash'],
+                           r['status'], r['status_detail']] for r in json.loads(expected)], lines)
+        with tempfile.TemporaryDirectory() as tmpdir:
+            name = os.path.join(tmpdir, 'a\tb.jpg')
+            shutil.copy('jpeginfo_test3.jpg', name)
+            output, _ = self.run_test(['--format=%f|%{size}%%\\n', name])
+            self.assertEqual(name.replace('\t', '\\t') + '|6720%\n', output)
+
+    def test_fields(self):
+        """test output of selected fields only"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg']
+        output, _ = self.run_test(['--fields=filename,width,height', '--md5'] + files)
+        self.assertEqual('jpeginfo_test1.jpg\t2100\t1500\njpeginfo_test2.jpg\t256\t183\n',
+                         output)
+        output, _ = self.run_test(['--csv', '-H', '--fields=filename,size,comments'] + files)
+        self.assertEqual('filename,size,comments\n"jpeginfo_test1.jpg",320159,""\n'
+                         '"jpeginfo_test2.jpg",12851,"This is a test comment."\n', output)
+        output, _ = self.run_test(['--json', '-c', '--fields=filename,status,type'] + files)
+        self.assertEqual([{'filename': f, 'status': 'OK', 'type': t} for f, t in
+                          zip(files, ['Exif,IPTC,XMP,ICC,Adobe,UNKNOWN', 'JFIF,COM'])],
+                         json.loads(output))
+
+    def test_where(self):
+        """test filter expressions and size limits"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg',
+                 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        output, _ = self.run_test(['-c', '--fields=filename',
+                                   '--where=width>=2000 && progressive && markers~ICC'] + files)
+        self.assertEqual('jpeginfo_test1.jpg\n', output)
+        output, _ = self.run_test(['-c', '--fields=filename',
+                                   '--where=!progressive && (status!=OK || comments~"test")'] + files,
+                                  check=False)
+        self.assertEqual('jpeginfo_test2.jpg\njpeginfo_test2_broken.jpg\n', output)
+        output, _ = self.run_test(['--fields=filename', '--min-size=3k', '--max-size=12k'] + files)
+        self.assertEqual('jpeginfo_test3.jpg\n', output)
+        output, res = self.run_test(['--where=width>>1'] + files, check=False)
+        self.assertEqual(1, res)
+        self.assertIn('invalid expression', output)
+
+    def test_out(self):
+        """test writing multiple outputs at once"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg',
+                 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        text, _ = self.run_test(['-c'] + files, check=False)
+        csv, _ = self.run_test(['-c', '--csv'] + files, check=False)
+        ndjson, _ = self.run_test(['-c', '--ndjson'] + files, check=False)
+        with tempfile.TemporaryDirectory() as tmpdir:
+            csvfile = os.path.join(tmpdir, 'output.csv')
+            ndjsonfile = os.path.join(tmpdir, 'output.ndjson')
+            output, _ = self.run_test(['-c', '--out', 'text:-', '--out', 'csv:' + csvfile,
+                                       '--out', 'ndjson:' + ndjsonfile] + files, check=False)
+            self.assertEqual(text, output)
+            with open(csvfile) as f:
+                self.assertEqual(csv, f.read())
+            with open(ndjsonfile) as f:
+                self.assertEqual(ndjson, f.read())
+            # interrupt to whole process group (as from terminal) must not lose output
+            watchdir = os.path.join(tmpdir, 'watch')
+            jsonfile = os.path.join(tmpdir, 'output.json')
+            os.mkdir(watchdir)
+            with subprocess.Popen([self.program, '-c', '--watch', watchdir, '--watch-delay', '50',
+                                   '--workers', '2', '--out', 'json:' + jsonfile,
+                                   '--out', 'csv:' + csvfile], start_new_session=True) as proc:
+                time.sleep(0.2)
+                shutil.copy('jpeginfo_test2.jpg', os.path.join(watchdir, 'new.jpg'))
+                time.sleep(0.5)
+                os.killpg(proc.pid, signal.SIGINT)
+                self.assertEqual(0, proc.wait(timeout=5))
+            with open(jsonfile) as f:
+                result = json.load(f)
+            self.assertEqual(1, len(result))
+            self.assertTrue(result[0]['filename'].endswith('new.jpg'))
+            with open(csvfile) as f:
+                self.assertEqual(1, len(f.read().splitlines()))
+        output, res = self.run_test(['--out', 'xml:-'] + files, check=False)
+        self.assertEqual(1, res)
+        self.assertIn('unknown output format', output)
+
+    def test_arrow(self):
+        """test Arrow IPC stream and file output"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg',
+                 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        with tempfile.TemporaryDirectory() as tmpdir:
+            streamfile = os.path.join(tmpdir, 'output.arrow')
+            featherfile = os.path.join(tmpdir, 'output.feather')
+            self.run_test(['-c', '--out', 'arrow:' + streamfile,
+                           '--out', 'feather:' + featherfile] + files, check=False)
+            with open(streamfile, 'rb') as f:
+                stream = f.read()
+            with open(featherfile, 'rb') as f:
+                feather = f.read()
+        # stream: schema message first, end-of-stream marker last
+        self.assertEqual(b'\xff\xff\xff\xff\x00\x00\x00\x00', stream[-8:])
+        self.assertEqual(0, len(stream) % 8)
+        columns = read_arrow_stream(stream)
+        records = json.loads(self.run_test(['-c', '--json'] + files, check=False)[0])
+        for name in ['filename', 'size', 'hash', 'width', 'height', 'type',
+                     'info', 'comments', 'status', 'status_detail']:
+            self.assertEqual([r[name] for r in records], list(columns[name]))
+        self.assertEqual([f'{d}bit' for d in columns['color_depth']],
+                         [r['color_depth'] for r in records])
+        self.assertEqual([r['mode'] == 'Progressive' for r in records], columns['progressive'])
+        self.assertEqual('jpeginfo_test2_broken.jpg', columns['filename'][2])
+        self.assertEqual('WARNING', columns['status'][2])
+        self.assertEqual('Premature end of JPEG file', columns['status_detail'][2])
+        self.assertEqual('', columns['status_detail'][1])
+        # file format: same stream between magic and footer
+        self.assertEqual(b'ARROW1\x00\x00', feather[:8])
+        self.assertEqual(b'ARROW1', feather[-6:])
+        self.assertEqual(stream, feather[8:8 + len(stream)])
+        output, res = self.run_test(['--arrow', '--format=%f'] + files, check=False)
+        self.assertEqual(1, res)
+        with open('/dev/full', 'wb') as full:
+            res = subprocess.run([self.program, '-c', '--arrow'] + files, stdout=full,
+                                 stderr=subprocess.PIPE, encoding='utf-8', check=False)
+        self.assertEqual(2, res.returncode)
+        self.assertIn('error writing Arrow output', res.stderr)
+
+    def test_checkpoint(self):
+        """test resuming from a checkpoint"""
+        files = ['jpeginfo_test1.jpg', 'jpeginfo_test2.jpg',
+                 'jpeginfo_test2_broken.jpg', 'jpeginfo_test3.jpg']
+        args = ['-c', '--json'] + files
+        expected, expected_res = self.run_test(args, check=False)
+        partial, _ = self.run_test(['-c', '--json'] + files[:2], check=False)
+        partial = partial[:partial.rindex('}') + 1]
+        with tempfile.TemporaryDirectory() as tmpdir:
+            checkpoint = os.path.join(tmpdir, 'checkpoint')
+            outfile = os.path.join(tmpdir, 'output.json')
+            # simulate run interrupted after 2 files (with some output after checkpoint)
+            with open(checkpoint, 'w') as f:
+                f.write('jpeginfo-checkpoint 1\nposition 2\nerrors 0\nrecords 2\n'
+                        f'header 1\noutput_offset {len(partial)}\ncomplete 0\n')
+            with open(outfile, 'w') as f:
+                f.write(partial + ',\n { "filename":"jpeginfo_te')
+            for _ in range(2):
+                with open(outfile, 'a') as f:
+                    res = subprocess.run([self.program, '--checkpoint', checkpoint] + args,
+                                         stdout=f, check=False).returncode
+                with open(outfile) as f:
+                    self.assertEqual(expected, f.read())
+                self.assertEqual(expected_res, res)
+            # output that cannot be truncated is refused
+            output, res = self.run_test(['--checkpoint', checkpoint] + args, check=False)
+            self.assertEqual(1, res)
+            self.assertIn('requires output', output)
+
     def test_comments(self):
         """test image comments"""
         output, _ = self.run_test(['-C', 'jpeginfo_test2.jpg'])
@@ -153,6 +723,22 @@ class JpeginfoTests(unittest.TestCase):
                              }
                          ])
 
+    def test_watch_mode(self):
+        """test watching directory for new files"""
+        with tempfile.TemporaryDirectory() as tmpdir:
+            with subprocess.Popen([self.program, '-c', '--json', '--watch', tmpdir,
+                                   '--watch-delay', '50'],
+                                  encoding="utf-8", stdout=subprocess.PIPE) as proc:
+                time.sleep(0.2)
+                shutil.copy('jpeginfo_test2.jpg', os.path.join(tmpdir, 'new.jpg'))
+                time.sleep(0.5)
+                proc.send_signal(signal.SIGINT)
+                output, _ = proc.communicate(timeout=5)
+        result = json.loads(output)
+        self.assertEqual(1, len(result))
+        self.assertEqual('OK', result[0]['status'])
+        self.assertTrue(result[0]['filename'].endswith('new.jpg'))
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,191 @@
+/* watch.c - directory watch mode for jpeginfo
+ *
+ * Copyright (c) 2025 Timo Kokkonen
+ * All Rights Reserved.
+ *
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * This file is part of JPEGinfo.
+ *
+ * JPEGinfo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * JPEGinfo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with JPEGinfo. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "jpeginfo.h"
+
+
+#ifdef __linux__
+
+struct pending_file {
+	char *name;
+	long long due;
+};
+
+static struct pending_file *pending = NULL;
+static int pending_count = 0;
+static int pending_size = 0;
+
+
+static long long now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/* Add file to the pending list, or push back its due time if already there. */
+static void pending_update(const char *name, long long due, int add)
+{
+	for (int i = 0; i < pending_count; i++) {
+		if (!strcmp(pending[i].name, name)) {
+			pending[i].due = due;
+			return;
+		}
+	}
+
+	if (!add)
+		return;
+
+	if (pending_count >= pending_size) {
+		pending_size = (pending_size > 0 ? pending_size * 2 : 64);
+		pending = realloc(pending, sizeof(struct pending_file) * pending_size);
+		if (!pending)
+			no_memory();
+	}
+	if (!(pending[pending_count].name = strdup(name)))
+		no_memory();
+	pending[pending_count].due = due;
+	pending_count++;
+}
+
+
+/* Process files that have not seen any activity during the debounce delay. */
+static void pending_run(const char *dir, long long now, void (*callback)(const char *))
+{
+	char path[MAXPATHLEN + 1];
+	int i = 0;
+
+	while (i < pending_count) {
+		if (pending[i].due > now) {
+			i++;
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", dir, pending[i].name);
+		free(pending[i].name);
+		pending[i] = pending[--pending_count];
+		callback(path);
+	}
+}
+
+
+int watch_directory(const char *dir, int delay, void (*callback)(const char *),
+		volatile sig_atomic_t *stop)
+{
+	char buf[64 * 1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	if (!dir || !callback)
+		return -1;
+
+	int fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "jpeginfo: inotify_init1() failed: %s\n", strerror(errno));
+		return -1;
+	}
+	if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_ONLYDIR) < 0) {
+		fprintf(stderr, "jpeginfo: cannot watch directory '%s': %s\n", dir, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	while (!(stop && *stop)) {
+		long long now = now_ms();
+		int timeout = -1;
+
+		for (int i = 0; i < pending_count; i++) {
+			int t = (pending[i].due > now ? pending[i].due - now : 0);
+			if (timeout < 0 || t < timeout)
+				timeout = t;
+		}
+
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		int r = poll(&pfd, 1, timeout);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "jpeginfo: poll() failed: %s\n", strerror(errno));
+			break;
+		}
+
+		if (r > 0) {
+			ssize_t len = read(fd, buf, sizeof(buf));
+			if (len < 0 && errno != EINTR && errno != EAGAIN) {
+				fprintf(stderr, "jpeginfo: inotify read failed: %s\n", strerror(errno));
+				break;
+			}
+			now = now_ms();
+			for (char *p = buf; len > 0 && p < buf + len; ) {
+				struct inotify_event *ev = (struct inotify_event*)p;
+				p += sizeof(struct inotify_event) + ev->len;
+
+				if (ev->len < 1 || ev->name[0] == '.' || (ev->mask & IN_ISDIR))
+					continue;
+				/* File modified while pending: someone is still writing it */
+				pending_update(ev->name, now + delay,
+					(ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)));
+			}
+		}
+
+		pending_run(dir, now_ms(), callback);
+	}
+
+	close(fd);
+	for (int i = 0; i < pending_count; i++)
+		free(pending[i].name);
+	free(pending);
+	pending = NULL;
+	pending_count = pending_size = 0;
+
+	return 0;
+}
+
+#else
+
+int watch_directory(const char *dir, int delay, void (*callback)(const char *),
+		volatile sig_atomic_t *stop)
+{
+	fprintf(stderr, "jpeginfo: watch mode not supported on this platform\n");
+	return -1;
+}
+
+#endif
+
+/* eof :-) */